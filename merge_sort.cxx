@@ -9,111 +9,18 @@
  * 
  */
 #include <iostream>
+#include <fstream>
 #include <cassert>
 #include <random>
 #include <array>
 #include <algorithm>
+#include <vector>
+#include <string>
 
-//#define _MERGE_SORT_PRINT_ 1
+#include "merge_sort.hxx"
 
 using namespace std;
 
-/**
- * @brief Merge sort both halves of the array 
- * 
- * @tparam T1 array type
- * @param parr master array to sort
- * @param begin starting index
- * @param m middle index
- * @param end ending index (one past last)
- */
-template<typename T1>
-void merge(T1* parr, size_t begin, size_t m, size_t end){
-    
-    // determinet the left half size of the array
-    size_t leftHalf = m - begin;
-    // determine the right half size of the array
-    size_t rightHalf = end - m;
-    
-    // let us allocate two buffers to hold left and right halves of the array
-    T1* leftBuff = new T1[leftHalf]; // <= left
-    T1* rightBuff = new T1[rightHalf]; // <= right
-
-    // copy the first half of the master array into left half buffer
-    size_t idxL = 0, idxR = 0, idxM = begin;
-    for(; idxL < leftHalf; idxL++, idxM++) {
-        leftBuff[idxL] = parr[idxM];
-    }
-    
-    // copy the second half of the master array into right half buffer
-    for(; idxR < rightHalf; idxR++) {
-        rightBuff[idxR] = parr[m + idxR];
-    }
-    
-    // reset indices: idxL - left; idxR - right; idxM - master array index
-    idxL = 0; idxR = 0; idxM = begin;
-    
-    // sort copy values from both halves
-    while (idxL < leftHalf && idxR < rightHalf) { // copy until at least one half is fully copied
-        // take a look at the left half if it is greater than the right half
-        if (leftBuff[idxL] <= rightBuff[idxR]) {
-            parr[idxM] = leftBuff[idxL];
-            idxL++;
-        } else {
-            // copy the right half into the master array
-            parr[idxM] = rightBuff[idxR];
-            idxR++;
-        }
-        idxM++; // adjust the master array index
-    }
-
-    // left half remainder copy over
-    for(; idxL < leftHalf; idxL++, idxM++) {
-        parr[idxM] = leftBuff[idxL];
-    }
-
-    // right half remainder copy over
-    for(; idxR < rightHalf; idxR++, idxM++) {
-        parr[idxM] = rightBuff[idxR];
-    }
-
-    // clean up left and right buffers
-    delete [] leftBuff;
-    delete [] rightBuff;
-
-#ifdef _MERGE_SORT_PRINT_    
-    for (int i = 0; i < end; i++) {
-        cout << "arr[" << i << "]=" << parr[i] << endl;
-    }
-#endif 
-}
-
-/**
- * @brief Divide and conquer merge source \
- *      keep on dividing the array into halves until only one element is left \
- *      on each side
- * @tparam T1 array type
- * @param parr pointer to array to sort
- * @param begin starting offset 
- * @param end ending offset (one past last)
- */
-template<typename T1>
-void mergeSort(T1* parr, size_t begin, size_t end) {
-    // break out recursion
-    if (begin >= end) return;
-    // if just one element - dont do anything
-    int m = begin + (end - begin)/2;
-    // if just element left - break out recursion
-    if (!(m-begin)) return;
-    // merge sort the left half of the array
-    mergeSort(parr, begin, m);
-    // merge sort the right half of the array
-    mergeSort(parr, m, end);
-    // merge both parts of the array
-    merge(parr, begin, m, end);
-}
-
-
 int main(){
 
     using T1 = int;
@@ -134,4 +41,62 @@ int main(){
         cout << v << ",";
     });
     cout << endl;
+
+    // the parallel sort must give exactly the sequential result
+    vector<T1> big(1 << 20);
+    generate(big.begin(), big.end(), [&](){return uniform_dist(rnd_eng);});
+    vector<T1> big_seq(big);
+    TaskPool pool;
+    parallelMergeSort<T1>(pool, big.data(), 0, big.size(), 1 << 12);
+    mergeSort<T1>(big_seq.data(), 0, big_seq.size());
+    assert(big == big_seq);
+    cout << "parallel merge sort on " << pool.size() << " workers: " << big.size() << " elements OK" << endl;
+
+    // nearly sorted input: the adaptive sort finds the runs instead of splitting blindly
+    vector<T1> nearly(big_seq);
+    for (size_t i = 0; i < nearly.size(); i += 1000) {
+        swap(nearly[i], nearly[(i*7919) % nearly.size()]);
+    }
+    vector<T1> nearly_seq(nearly);
+    adaptiveMergeSort<T1>(nearly.data(), 0, nearly.size());
+    mergeSort<T1>(nearly_seq.data(), 0, nearly_seq.size());
+    assert(nearly == nearly_seq);
+    cout << "adaptive merge sort on nearly sorted input: OK" << endl;
+
+    // records sorted by a key field: radix path for the integer key, merge sort for the name
+    struct Order { string name; int64_t qty; };
+    vector<Order> orders{{"pear", 7}, {"fig", -3}, {"apple", 7}, {"kiwi", 0}, {"date", -3}};
+    stableSort(orders, less<>(), &Order::qty);
+    assert(orders[0].name == "fig" && orders[1].name == "date" && orders[4].name == "apple");
+    stableSort(orders, greater<>(), &Order::name);
+    assert(orders[0].name == "pear" && orders[4].name == "apple");
+    cout << "projected stable sort of records: OK" << endl;
+
+    // one argsort of the key column reorders every column of the table
+    vector<int64_t> qty{7, -3, 7, 0, -3};
+    vector<string> item{"pear", "fig", "apple", "kiwi", "date"};
+    auto perm = argSort(qty);
+    applyPermutation(qty.begin(), perm);
+    applyPermutation(item.begin(), perm);
+    assert(is_sorted(qty.begin(), qty.end()) && item[0] == "fig" && item[1] == "date" && item[4] == "apple");
+    cout << "argsort of a column table: OK" << endl;
+
+    // out of core: a 1 MB budget forces many runs and more than one merge pass
+    string in_path = "/tmp/merge_sort_demo.in", out_path = "/tmp/merge_sort_demo.out";
+    shuffle(big_seq.begin(), big_seq.end(), mt19937(rnd_eng()));
+    {
+        ofstream in_file(in_path, ios::binary);
+        in_file.write(reinterpret_cast<const char*>(big_seq.data()), big_seq.size()*sizeof(T1));
+    }
+    ExternalSortOptions opt;
+    opt.memoryBudget = 1 << 20;
+    opt.fanIn = 4;
+    externalMergeSort<T1>(in_path, out_path, opt);
+    vector<T1> big_ext(big.size());
+    ifstream out_file(out_path, ios::binary);
+    out_file.read(reinterpret_cast<char*>(big_ext.data()), big_ext.size()*sizeof(T1));
+    assert(big_ext == big);
+    remove(in_path.c_str());
+    remove(out_path.c_str());
+    cout << "external merge sort with a " << opt.memoryBudget << " bytes budget: OK" << endl;
 }
\ No newline at end of file
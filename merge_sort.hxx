@@ -0,0 +1,1866 @@
+/**
+ * @file merge_sort.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Merge sort algorithm family: sequential, parallel, adaptive, external memory
+ *      and projected/radix sorts. Header only - every program sorting with
+ *      mergeSort() includes it.
+ * @version 0.2
+ * @date 2026-10-17
+ * 
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ * 
+ */
+#ifndef _MERGE_SORT_HXX_
+#define _MERGE_SORT_HXX_
+
+#include <iostream>
+#include <array>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+//#define _MERGE_SORT_PRINT_ 1
+
+using namespace std;
+
+/**
+ * @brief Default ordering of the merge sort: only operator <= is required \
+ *      a is strictly before b when b <= a does not hold.
+ */
+struct MergeLess {
+    template<typename T1>
+    bool operator()(const T1& a, const T1& b) const { return !(b <= a); }
+};
+
+/**
+ * @brief Branchless stable merge of two sorted ranges \
+ *      the comparison result drives both index increments and a conditional move, \
+ *      so random input does not pay a branch mispredict per element. \
+ *      Meant for cheap to copy (arithmetic) types.
+ * @tparam T1 array type
+ * @param pleft left sorted range
+ * @param leftHalf number of elements in the left range
+ * @param pright right sorted range
+ * @param rightHalf number of elements in the right range
+ * @param dst destination of (leftHalf + rightHalf) elements
+ */
+template<typename T1>
+void branchlessMergeRanges(T1* pleft, size_t leftHalf, T1* pright, size_t rightHalf, T1* dst) {
+    size_t idxL = 0, idxR = 0;
+    while (idxL < leftHalf && idxR < rightHalf) {
+        T1 l = pleft[idxL], r = pright[idxR];
+        bool takeRight = r < l;
+        *dst++ = takeRight ? r : l;
+        idxR += takeRight;
+        idxL += !takeRight;
+    }
+    dst = copy(pleft + idxL, pleft + leftHalf, dst);
+    copy(pright + idxR, pright + rightHalf, dst);
+}
+
+/**
+ * @brief key types the vectorized merge handles: 32 bit integers and signed \
+ *      64 bit integers. Floating point keys take the branchless merge - the \
+ *      network may swap -0.0 and +0.0, which compare equal, and the sort is stable.
+ */
+template<typename T1>
+constexpr bool isSimdMergeKey = is_integral_v<T1> && !is_same_v<T1, bool> &&
+                                (sizeof(T1) == 4 || (sizeof(T1) == 8 && is_signed_v<T1>));
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define _MERGE_SORT_SIMD_ 1
+#endif
+
+#ifdef _MERGE_SORT_SIMD_
+/**
+ * @brief Bitonic merge network over one register sized block of W keys \
+ *      written with GCC vector extensions, so the same code is compiled to \
+ *      SSE4, AVX2 or AVX-512 depending on the kernel it is inlined into. \
+ *      Vectors are only passed by reference: nothing here is ever called \
+ *      outside of those kernels.
+ * @tparam T1 key type
+ * @tparam W number of lanes
+ */
+template<typename T1, size_t W, typename Lanes = make_index_sequence<W>>
+struct BitonicBlock;
+
+template<typename T1, size_t W, size_t... I>
+struct BitonicBlock<T1, W, index_sequence<I...>> {
+    typedef T1 Vec __attribute__((vector_size(W*sizeof(T1))));
+    using Lane = conditional_t<sizeof(T1) == 4, int32_t, int64_t>;
+    typedef Lane Mask __attribute__((vector_size(W*sizeof(T1))));
+
+    // lane i <- lane W-1-i
+    static constexpr Mask reverseMask = {Lane(W - 1 - I)...};
+    // lane i <- its partner at distance d
+    template<size_t d>
+    static constexpr Mask partnerMask = {Lane(I ^ d)...};
+    // lower lane of each pair takes the min, upper lane takes the max
+    template<size_t d>
+    static constexpr Mask pickMask = {Lane((I & d) ? W + I : I)...};
+
+    // one half cleaner stage at distance d
+    template<size_t d>
+    __attribute__((always_inline)) static inline void stage(Vec& v) {
+        Vec p = __builtin_shuffle(v, partnerMask<d>);
+        auto lt = v < p;
+        Vec mn = lt ? v : p;
+        Vec mx = lt ? p : v;
+        v = __builtin_shuffle(mn, mx, pickMask<d>);
+    }
+
+    // sort a bitonic block: log2(W) half cleaner stages
+    __attribute__((always_inline)) static inline void clean(Vec& v) {
+        if constexpr (W >= 16) stage<8>(v);
+        if constexpr (W >= 8) stage<4>(v);
+        if constexpr (W >= 4) stage<2>(v);
+        stage<1>(v);
+    }
+
+    /**
+     * @brief Merge two sorted blocks: lo gets the W smallest, hi the W largest keys
+     */
+    __attribute__((always_inline)) static inline void merge(Vec& lo, Vec& hi) {
+        Vec r = __builtin_shuffle(hi, reverseMask);
+        auto lt = lo < r;
+        Vec l = lt ? lo : r;
+        hi = lt ? r : lo;
+        lo = l;
+        clean(lo);
+        clean(hi);
+    }
+};
+
+/**
+ * @brief Vectorized merge of two sorted ranges \
+ *      keeps the W largest keys seen so far in a register and merges in the next \
+ *      block from whichever side has the smaller head. Tails shorter than a block \
+ *      are finished with the branchless scalar merge.
+ * @tparam T1 key type
+ * @tparam W number of lanes
+ */
+template<typename T1, size_t W>
+__attribute__((always_inline)) inline void simdMergeKernel(T1* pleft, size_t leftHalf, T1* pright, size_t rightHalf, T1* dst) {
+    using Block = BitonicBlock<T1, W>;
+    using Vec = typename Block::Vec;
+    if (leftHalf < W || rightHalf < W) {
+        branchlessMergeRanges(pleft, leftHalf, pright, rightHalf, dst);
+        return;
+    }
+    Vec lo, hi;
+    memcpy(&lo, pleft, sizeof(Vec));
+    memcpy(&hi, pright, sizeof(Vec));
+    size_t idxL = W, idxR = W;
+    for (;;) {
+        Block::merge(lo, hi);
+        memcpy(dst, &lo, sizeof(Vec));
+        dst += W;
+        if (idxL + W > leftHalf || idxR + W > rightHalf) break;
+        if (pleft[idxL] <= pright[idxR]) {
+            memcpy(&lo, pleft + idxL, sizeof(Vec));
+            idxL += W;
+        } else {
+            memcpy(&lo, pright + idxR, sizeof(Vec));
+            idxR += W;
+        }
+    }
+    // hi and both tails are sorted, at least one tail is shorter than a block:
+    // merge hi with the short tail on the stack, then that with the long tail
+    T1 pending[W], tail[2*W];
+    memcpy(pending, &hi, sizeof(Vec));
+    if (leftHalf - idxL < W) {
+        branchlessMergeRanges(pending, W, pleft + idxL, leftHalf - idxL, tail);
+        branchlessMergeRanges(tail, W + leftHalf - idxL, pright + idxR, rightHalf - idxR, dst);
+    } else {
+        branchlessMergeRanges(pending, W, pright + idxR, rightHalf - idxR, tail);
+        branchlessMergeRanges(tail, W + rightHalf - idxR, pleft + idxL, leftHalf - idxL, dst);
+    }
+}
+
+template<typename T1>
+__attribute__((target("avx512f"))) void simdMergeAvx512(T1* pleft, size_t leftHalf, T1* pright, size_t rightHalf, T1* dst) {
+    simdMergeKernel<T1, 64/sizeof(T1)>(pleft, leftHalf, pright, rightHalf, dst);
+}
+
+template<typename T1>
+__attribute__((target("avx2"))) void simdMergeAvx2(T1* pleft, size_t leftHalf, T1* pright, size_t rightHalf, T1* dst) {
+    simdMergeKernel<T1, 32/sizeof(T1)>(pleft, leftHalf, pright, rightHalf, dst);
+}
+
+template<typename T1>
+__attribute__((target("sse4.2"))) void simdMergeSse4(T1* pleft, size_t leftHalf, T1* pright, size_t rightHalf, T1* dst) {
+    simdMergeKernel<T1, 16/sizeof(T1)>(pleft, leftHalf, pright, rightHalf, dst);
+}
+
+#endif // _MERGE_SORT_SIMD_
+
+/**
+ * @brief Merge two sorted ranges of arithmetic keys with the widest \
+ *      merge kernel the CPU supports. The kernel is picked once per key type \
+ *      at first use; without SIMD support the branchless scalar merge is used. \
+ *      Equal integer keys are indistinguishable, so the merge stays stable.
+ * @tparam T1 key type (see isSimdMergeKey)
+ */
+template<typename T1>
+void simdMergeRanges(T1* pleft, size_t leftHalf, T1* pright, size_t rightHalf, T1* dst) {
+    using MergeFn = void (*)(T1*, size_t, T1*, size_t, T1*);
+    static const MergeFn mergeFn = [](){
+        MergeFn fn = branchlessMergeRanges<T1>;
+#ifdef _MERGE_SORT_SIMD_
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            fn = simdMergeAvx512<T1>;
+        } else if (__builtin_cpu_supports("avx2")) {
+            fn = simdMergeAvx2<T1>;
+        } else if (__builtin_cpu_supports("sse4.2")) {
+            fn = simdMergeSse4<T1>;
+        }
+#endif
+        return fn;
+    }();
+    mergeFn(pleft, leftHalf, pright, rightHalf, dst);
+}
+
+/**
+ * @brief Move-merge two sorted ranges into the destination array
+ *      Ties are taken from the left range first, so the merge is stable.
+ *      The destination must not overlap either source range.
+ * 
+ * @tparam T1 array type
+ * @tparam Less strict ordering of two elements
+ * @param pleft left sorted range
+ * @param leftHalf number of elements in the left range
+ * @param pright right sorted range
+ * @param rightHalf number of elements in the right range
+ * @param dst destination of (leftHalf + rightHalf) elements
+ * @param less ordering instance
+ */
+template<typename T1, typename Less = MergeLess>
+void mergeRanges(T1* pleft, size_t leftHalf, T1* pright, size_t rightHalf, T1* dst, Less less = Less()) {
+    // arithmetic keys in natural order take the vectorized or branchless path
+    if constexpr (is_same_v<Less, MergeLess> && isSimdMergeKey<T1>) {
+        simdMergeRanges(pleft, leftHalf, pright, rightHalf, dst);
+        return;
+    } else if constexpr (is_same_v<Less, MergeLess> && is_arithmetic_v<T1>) {
+        branchlessMergeRanges(pleft, leftHalf, pright, rightHalf, dst);
+        return;
+    }
+    size_t idxL = 0, idxR = 0, idxM = 0;
+
+    // move values from both halves, smallest first
+    while (idxL < leftHalf && idxR < rightHalf) {
+        if (!less(pright[idxR], pleft[idxL])) {
+            dst[idxM++] = std::move(pleft[idxL++]);
+        } else {
+            dst[idxM++] = std::move(pright[idxR++]);
+        }
+    }
+    // only one of the two remainders is non empty
+    for(; idxL < leftHalf; idxL++, idxM++) {
+        dst[idxM] = std::move(pleft[idxL]);
+    }
+    for(; idxR < rightHalf; idxR++, idxM++) {
+        dst[idxM] = std::move(pright[idxR]);
+    }
+}
+
+/**
+ * @brief Move-merge both sorted halves of the source array into the destination array
+ *      src[begin, m) and src[m, end) are merged into dst[begin, end). The two arrays
+ *      must not overlap.
+ * 
+ * @tparam T1 array type
+ * @param src array holding both sorted halves
+ * @param begin starting index
+ * @param m middle index
+ * @param end ending index (one past last)
+ * @param dst array receiving the merged range (same indexing as src)
+ * @param less ordering instance
+ */
+template<typename T1, typename Less = MergeLess>
+void mergeInto(T1* src, size_t begin, size_t m, size_t end, T1* dst, Less less = Less()) {
+    mergeRanges(src + begin, m - begin, src + m, end - m, dst + begin, less);
+}
+
+/**
+ * @brief Merge sort both halves of the array using a caller supplied scratch buffer
+ *      Only the left half is moved out into the scratch buffer. The right half stays
+ *      where it is: the write index can never overtake the right read index.
+ * 
+ * @tparam T1 array type
+ * @param parr master array to sort
+ * @param begin starting index
+ * @param m middle index
+ * @param end ending index (one past last)
+ * @param pscratch scratch buffer of at least (m - begin) elements
+ */
+template<typename T1>
+void merge(T1* parr, size_t begin, size_t m, size_t end, T1* pscratch) {
+    // determine the left half size of the array
+    size_t leftHalf = m - begin;
+
+    // move the first half of the master array into the scratch buffer
+    for(size_t idx = 0; idx < leftHalf; idx++) {
+        pscratch[idx] = std::move(parr[begin + idx]);
+    }
+
+    // reset indices: idxL - left (scratch); idxR - right (in place); idxM - master array index
+    size_t idxL = 0, idxR = m, idxM = begin;
+    while (idxL < leftHalf && idxR < end) { // copy until at least one half is fully copied
+        if (pscratch[idxL] <= parr[idxR]) {
+            parr[idxM++] = std::move(pscratch[idxL++]);
+        } else {
+            parr[idxM++] = std::move(parr[idxR++]);
+        }
+    }
+
+    // left half remainder move over - a right half remainder is already in place
+    for(; idxL < leftHalf; idxL++, idxM++) {
+        parr[idxM] = std::move(pscratch[idxL]);
+    }
+
+#ifdef _MERGE_SORT_PRINT_    
+    for (size_t i = 0; i < end; i++) {
+        cout << "arr[" << i << "]=" << parr[i] << endl;
+    }
+#endif 
+}
+
+/**
+ * @brief Merge sort both halves of the array 
+ *      Stand alone version - allocates a scratch buffer for the left half on every call.
+ *      mergeSort() does not use it: it shares one buffer across the whole recursion.
+ * 
+ * @tparam T1 array type
+ * @param parr master array to sort
+ * @param begin starting index
+ * @param m middle index
+ * @param end ending index (one past last)
+ */
+template<typename T1>
+void merge(T1* parr, size_t begin, size_t m, size_t end){
+    unique_ptr<T1[]> leftBuff(new T1[m - begin]);
+    merge(parr, begin, m, end, leftBuff.get());
+}
+
+/**
+ * @brief Default size below which mergeSort() stops recursing and sorts the leaf directly
+ * @tparam T1 array type
+ */
+template<typename T1>
+constexpr size_t mergeSortLeafSize = 16;
+
+/**
+ * @brief Comparator (compare-exchange pair) of a sorting network
+ */
+struct NetworkComparator {
+    uint8_t lo, hi;
+};
+
+/**
+ * @brief Batcher odd-even merge sort network for N inputs, built at compile time \
+ *      the network for the next power of two is generated and every comparator \
+ *      touching an index >= N is dropped: those inputs act as +infinity and \
+ *      would never be exchanged. Visits the comparators in order through f.
+ * @return number of comparators visited
+ */
+template<typename F>
+constexpr size_t batcherNetwork(size_t N, F f) {
+    size_t P = 1, count = 0;
+    while (P < N) P *= 2;
+    for (size_t p = 1; p < P; p *= 2) {
+        for (size_t k = p; k >= 1; k /= 2) {
+            for (size_t j = k % p; j + k < P; j += 2*k) {
+                for (size_t i = 0; i < k && i + j + k < P; i++) {
+                    size_t a = i + j, b = i + j + k;
+                    if (a/(2*p) == b/(2*p) && b < N) {
+                        f(a, b);
+                        count++;
+                    }
+                }
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Comparator table of the N input network
+ */
+template<size_t N>
+struct SortingNetwork {
+    static constexpr size_t size = batcherNetwork(N, [](size_t, size_t){});
+
+    static constexpr array<NetworkComparator, size> make() {
+        array<NetworkComparator, size> net{};
+        size_t c = 0;
+        batcherNetwork(N, [&](size_t a, size_t b){
+            net[c++] = NetworkComparator{uint8_t(a), uint8_t(b)};
+        });
+        return net;
+    }
+
+    static constexpr array<NetworkComparator, size> comparators = make();
+};
+
+/**
+ * @brief Branchless compare-exchange: a gets the smaller, b the larger value
+ */
+template<typename T1>
+inline void compareExchange(T1& a, T1& b) {
+    T1 x = a, y = b;
+    bool swapped = y < x;
+    a = swapped ? y : x;
+    b = swapped ? x : y;
+}
+
+/**
+ * @brief Apply the N input network to parr[0, N) - fully unrolled at compile time
+ */
+template<typename T1, size_t N, size_t... C>
+inline void sortNetwork([[maybe_unused]] T1* parr, index_sequence<C...>) {
+    constexpr auto& net = SortingNetwork<N>::comparators;
+    (compareExchange(parr[net[C].lo], parr[net[C].hi]), ...);
+}
+
+template<typename T1, size_t N>
+void sortNetwork(T1* parr) {
+    sortNetwork<T1, N>(parr, make_index_sequence<SortingNetwork<N>::size>());
+}
+
+// table of the networks for every leaf length 0..sizeof...(N)-1
+template<typename T1, size_t... N>
+constexpr auto sortNetworkTable(index_sequence<N...>) {
+    return array<void (*)(T1*), sizeof...(N)>{sortNetwork<T1, N>...};
+}
+
+/**
+ * @brief Sort a leaf of up to LeafSize elements in place \
+ *      integer keys go through the sorting network for exactly n inputs \
+ *      (equal integers are indistinguishable, so the network cannot break stability). \
+ *      Any other type uses insertion sort, which is stable - floating point keys \
+ *      included: -0.0 and +0.0 compare equal and the network may swap them.
+ * @tparam T1 array type
+ * @tparam LeafSize largest leaf
+ * @tparam Less strict ordering of two elements
+ * @param parr pointer to the leaf
+ * @param n number of elements (n <= LeafSize)
+ * @param less ordering instance - networks are only used for the default one
+ */
+template<typename T1, size_t LeafSize, typename Less = MergeLess>
+void sortLeaf(T1* parr, size_t n, Less less = Less()) {
+    if constexpr (is_same_v<Less, MergeLess> && is_integral_v<T1> && LeafSize > 1) {
+        static_assert(LeafSize <= 64, "sorting networks are generated for up to 64 inputs");
+        // one fully unrolled network per leaf length
+        static constexpr auto table = sortNetworkTable<T1>(make_index_sequence<LeafSize + 1>());
+        table[n](parr);
+    } else {
+        for (size_t i = 1; i < n; i++) {
+            if (!less(parr[i], parr[i - 1])) continue;
+            T1 v = std::move(parr[i]);
+            size_t j = i;
+            for (; j > 0 && less(v, parr[j - 1]); j--) {
+                parr[j] = std::move(parr[j - 1]);
+            }
+            parr[j] = std::move(v);
+        }
+    }
+}
+
+/**
+ * @brief Ping-pong recursion of the merge sort \
+ *      sorts parr[0, n) and leaves the result either in parr or in pscratch. \
+ *      Both halves are sorted into the buffer we are NOT going to end up in, \
+ *      so each level merges straight from one buffer into the other and \
+ *      no copy back is ever needed. Leaves of up to LeafSize elements are \
+ *      sorted in place by sortLeaf().
+ * @tparam T1 array type
+ * @tparam LeafSize recursion cut off
+ * @tparam Less strict ordering of two elements
+ * @param parr pointer to array to sort
+ * @param pscratch pointer to scratch buffer of n elements
+ * @param n number of elements
+ * @param toScratch true - result goes into pscratch; false - result goes into parr
+ * @param less ordering instance
+ */
+template<typename T1, size_t LeafSize = mergeSortLeafSize<T1>, typename Less = MergeLess>
+void mergeSortPingPong(T1* parr, T1* pscratch, size_t n, bool toScratch, Less less = Less()) {
+    if (n <= LeafSize || n < 2) {
+        // a leaf is sorted in place - just make sure it lands on the right side
+        sortLeaf<T1, LeafSize>(parr, n, less);
+        if (toScratch) move(parr, parr + n, pscratch);
+        return;
+    }
+    size_t m = n/2;
+    // sort both halves into the other buffer
+    mergeSortPingPong<T1, LeafSize>(parr, pscratch, m, !toScratch, less);
+    mergeSortPingPong<T1, LeafSize>(parr + m, pscratch + m, n - m, !toScratch, less);
+    // and merge them back into the one we were asked for
+    if (toScratch) {
+        mergeInto(parr, 0, m, n, pscratch, less);
+    } else {
+        mergeInto(pscratch, 0, m, n, parr, less);
+    }
+}
+
+/**
+ * @brief Divide and conquer merge sort with a caller supplied scratch buffer \
+ *      no allocations are made: pscratch must hold at least (end - begin) \
+ *      elements and can be reused across calls.
+ * @tparam T1 array type
+ * @tparam LeafSize ranges of up to LeafSize elements are sorted without recursing
+ * @tparam Less strict ordering of two elements
+ * @param parr pointer to array to sort
+ * @param begin starting offset 
+ * @param end ending offset (one past last)
+ * @param pscratch scratch buffer of at least (end - begin) elements
+ * @param less ordering instance (default: operator <=)
+ */
+template<typename T1, size_t LeafSize = mergeSortLeafSize<T1>, typename Less = MergeLess>
+void mergeSort(T1* parr, size_t begin, size_t end, T1* pscratch, Less less = Less()) {
+    // break out recursion
+    if (begin >= end || end - begin < 2) return;
+    mergeSortPingPong<T1, LeafSize>(parr + begin, pscratch, end - begin, false, less);
+}
+
+/**
+ * @brief Divide and conquer merge sort \
+ *      keep on dividing the array into halves until only one element is left \
+ *      on each side. One scratch buffer of (end - begin) elements is taken from \
+ *      the allocator up front and used by every merge step.
+ * @tparam T1 array type
+ * @tparam LeafSize ranges of up to LeafSize elements are sorted without recursing
+ * @tparam Alloc allocator type used for the scratch buffer
+ * @param parr pointer to array to sort
+ * @param begin starting offset 
+ * @param end ending offset (one past last)
+ * @param alloc allocator instance
+ */
+template<typename T1, size_t LeafSize = mergeSortLeafSize<T1>, typename Alloc = allocator<T1>>
+void mergeSort(T1* parr, size_t begin, size_t end, Alloc alloc = Alloc()) {
+    if (begin >= end || end - begin < 2) return;
+    using traits = allocator_traits<Alloc>;
+    size_t n = end - begin;
+    T1* pscratch = traits::allocate(alloc, n);
+    size_t constructed = 0;
+    try {
+        for (; constructed < n; constructed++) {
+            traits::construct(alloc, pscratch + constructed);
+        }
+        mergeSort<T1, LeafSize>(parr, begin, end, pscratch);
+    } catch (...) {
+        for (size_t i = 0; i < constructed; i++) traits::destroy(alloc, pscratch + i);
+        traits::deallocate(alloc, pscratch, n);
+        throw;
+    }
+    for (size_t i = 0; i < n; i++) traits::destroy(alloc, pscratch + i);
+    traits::deallocate(alloc, pscratch, n);
+}
+
+/**
+ * @brief Identity projection - the element is its own key
+ */
+struct Identity {
+    template<typename T>
+    constexpr T&& operator()(T&& t) const noexcept { return std::forward<T>(t); }
+};
+
+/**
+ * @brief Keys the LSD radix path handles: integers (but bool) and floating point
+ */
+template<typename K>
+constexpr bool isRadixKey = (is_integral_v<K> && !is_same_v<K, bool>) ||
+                            (is_floating_point_v<K> && (sizeof(K) == 4 || sizeof(K) == 8));
+
+/**
+ * @brief Map a key to an unsigned integer with the same order \
+ *      signed integers get their sign bit flipped; negative floats are bit \
+ *      inverted and positive ones get the sign bit set. -0.0 is taken as +0.0 \
+ *      first: the two compare equal and must keep their order.
+ */
+template<typename K>
+inline auto radixBits(K key) {
+    using U = make_unsigned_t<conditional_t<is_floating_point_v<K>,
+                                            conditional_t<sizeof(K) == 4, int32_t, int64_t>, K>>;
+    constexpr U signBit = U(1) << (8*sizeof(U) - 1);
+    if constexpr (is_floating_point_v<K>) {
+        key += K(0);                    // -0.0 + 0.0 == +0.0, everything else unchanged
+        U u;
+        memcpy(&u, &key, sizeof(u));
+        return (u & signBit) ? U(~u) : U(u | signBit);
+    } else if constexpr (is_signed_v<K>) {
+        return U(U(key) ^ signBit);
+    } else {
+        return U(key);
+    }
+}
+
+/**
+ * @brief Stable LSD radix sort of records by an unsigned key \
+ *      all digit histograms are built in one read pass; a digit whose histogram \
+ *      has a single non empty bucket is skipped. Records ping-pong between parr \
+ *      and ptmp and end up in parr.
+ * @tparam DigitBits bits per digit (8, 11 or 16)
+ * @tparam Rec record type
+ * @tparam GetKey callable returning the unsigned key of a record
+ * @param parr records to sort
+ * @param ptmp scratch of n records
+ * @param n number of records
+ * @param key key extractor
+ */
+template<unsigned DigitBits, typename Rec, typename GetKey>
+void lsdRadixSort(Rec* parr, Rec* ptmp, size_t n, GetKey key) {
+    using U = decltype(key(*parr));
+    constexpr unsigned keyBits = 8*sizeof(U);
+    constexpr unsigned passes = (keyBits + DigitBits - 1)/DigitBits;
+    constexpr size_t buckets = size_t(1) << DigitBits;
+    constexpr U digitMask = U(buckets - 1);
+    // how far ahead of the read position we ask for the next records
+    constexpr size_t prefetchDistance = 64/sizeof(Rec) + 8;
+
+    vector<size_t> hist(passes*buckets, 0);
+    for (size_t i = 0; i < n; i++) {
+        if (i + prefetchDistance < n) __builtin_prefetch(parr + i + prefetchDistance);
+        U k = key(parr[i]);
+        for (unsigned p = 0; p < passes; p++) {
+            hist[p*buckets + ((k >> (p*DigitBits)) & digitMask)]++;
+        }
+    }
+
+    Rec* src = parr;
+    Rec* dst = ptmp;
+    for (unsigned p = 0; p < passes; p++) {
+        size_t* h = &hist[p*buckets];
+        // all keys share this digit - the pass would not move anything
+        if (h[(key(src[0]) >> (p*DigitBits)) & digitMask] == n) continue;
+        // turn counts into starting offsets
+        size_t sum = 0;
+        for (size_t b = 0; b < buckets; b++) {
+            size_t c = h[b];
+            h[b] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (i + prefetchDistance < n) __builtin_prefetch(src + i + prefetchDistance);
+            dst[h[(key(src[i]) >> (p*DigitBits)) & digitMask]++] = std::move(src[i]);
+        }
+        swap(src, dst);
+    }
+    if (src != parr) move(src, src + n, parr);
+}
+
+/**
+ * @brief Radix sort with the digit width picked from the key width and n \
+ *      small inputs use 8 bit digits (cheap histograms), 32 bit keys 11 bit \
+ *      digits (3 passes) and large inputs with 64 bit keys 16 bit digits (4 passes).
+ */
+template<typename Rec, typename GetKey>
+void radixSort(Rec* parr, Rec* ptmp, size_t n, GetKey key) {
+    if (n < 2) return;
+    constexpr size_t keyBytes = sizeof(decltype(key(*parr)));
+    if (keyBytes <= 2 || n < (size_t(1) << 16)) {
+        lsdRadixSort<8>(parr, ptmp, n, key);
+    } else if (keyBytes == 8 && n >= (size_t(1) << 22)) {
+        lsdRadixSort<16>(parr, ptmp, n, key);
+    } else {
+        lsdRadixSort<11>(parr, ptmp, n, key);
+    }
+}
+
+/**
+ * @brief Is the comparator one of std::less / std::greater over keys of type K
+ * @return +1 ascending, -1 descending, 0 any other comparator
+ */
+template<typename Comp, typename K>
+constexpr int radixDirection() {
+    if constexpr (is_same_v<Comp, less<>> || is_same_v<Comp, less<K>>) return 1;
+    else if constexpr (is_same_v<Comp, greater<>> || is_same_v<Comp, greater<K>>) return -1;
+    else return 0;
+}
+
+/**
+ * @brief iterators the comparison path can sort in place: pointers and vector iterators
+ */
+template<typename It>
+constexpr bool isContiguousIterator = is_pointer_v<It> ||
+    (!is_same_v<typename iterator_traits<It>::value_type, bool> &&
+     is_same_v<It, typename vector<typename iterator_traits<It>::value_type>::iterator>);
+
+/**
+ * @brief Stable merge of two sorted runs held as separate key and index arrays
+ *      keys[0, m) and keys[m, n) (with their indices) are merged into dstKeys/dstIdx.
+ */
+template<typename K, typename Index, typename Less>
+void argMergeRanges(K* keys, Index* idx, size_t m, size_t n, K* dstKeys, Index* dstIdx, Less less) {
+    size_t idxL = 0, idxR = m, idxM = 0;
+    while (idxL < m && idxR < n) {
+        bool takeRight = less(keys[idxR], keys[idxL]);
+        size_t from = takeRight ? idxR : idxL;
+        dstKeys[idxM] = std::move(keys[from]);
+        dstIdx[idxM++] = idx[from];
+        idxR += takeRight;
+        idxL += !takeRight;
+    }
+    for (; idxL < m; idxL++, idxM++) {
+        dstKeys[idxM] = std::move(keys[idxL]);
+        dstIdx[idxM] = idx[idxL];
+    }
+    for (; idxR < n; idxR++, idxM++) {
+        dstKeys[idxM] = std::move(keys[idxR]);
+        dstIdx[idxM] = idx[idxR];
+    }
+}
+
+/**
+ * @brief Ping-pong merge sort of a structure of arrays: keys and their indices \
+ *      same buffer discipline as mergeSortPingPong(); only the compact keys are \
+ *      compared and only keys and indices are moved.
+ */
+template<typename K, typename Index, typename Less>
+void argMergeSortPingPong(K* keys, Index* idx, K* keysTmp, Index* idxTmp, size_t n, bool toScratch, Less less) {
+    if (n <= mergeSortLeafSize<K> || n < 2) {
+        // stable insertion sort of the leaf
+        for (size_t i = 1; i < n; i++) {
+            if (!less(keys[i], keys[i - 1])) continue;
+            K k = std::move(keys[i]);
+            Index x = idx[i];
+            size_t j = i;
+            for (; j > 0 && less(k, keys[j - 1]); j--) {
+                keys[j] = std::move(keys[j - 1]);
+                idx[j] = idx[j - 1];
+            }
+            keys[j] = std::move(k);
+            idx[j] = x;
+        }
+        if (toScratch) {
+            move(keys, keys + n, keysTmp);
+            copy(idx, idx + n, idxTmp);
+        }
+        return;
+    }
+    size_t m = n/2;
+    argMergeSortPingPong(keys, idx, keysTmp, idxTmp, m, !toScratch, less);
+    argMergeSortPingPong(keys + m, idx + m, keysTmp + m, idxTmp + m, n - m, !toScratch, less);
+    if (toScratch) {
+        argMergeRanges(keys, idx, m, n, keysTmp, idxTmp, less);
+    } else {
+        argMergeRanges(keysTmp, idxTmp, m, n, keys, idx, less);
+    }
+}
+
+/**
+ * @brief argSort() worker with a given index width
+ */
+template<typename Index, typename It, typename Comp, typename Proj>
+void argSortInto(It first, size_t n, Comp comp, Proj proj, size_t* pperm) {
+    using T1 = typename iterator_traits<It>::value_type;
+    using K = decay_t<invoke_result_t<Proj&, T1&>>;
+
+    if constexpr (isRadixKey<K> && radixDirection<Comp, K>() != 0) {
+        // radix passes scatter key and index together - one packed record is one write stream
+        constexpr bool descending = radixDirection<Comp, K>() < 0;
+        using U = decltype(radixBits<K>(declval<K>()));
+        struct KeyIndex { U key; Index idx; };
+        vector<KeyIndex> pairs(n), tmp(n);
+        for (size_t i = 0; i < n; i++) {
+            U u = radixBits<K>(invoke(proj, first[i]));
+            pairs[i] = KeyIndex{descending ? U(~u) : u, Index(i)};
+        }
+        radixSort(pairs.data(), tmp.data(), n, [](const KeyIndex& p){ return p.key; });
+        for (size_t i = 0; i < n; i++) pperm[i] = pairs[i].idx;
+    } else {
+        // structure of arrays: the keys are compared, the indices just ride along
+        unique_ptr<K[]> keys(new K[n]), keysTmp(new K[n]);
+        unique_ptr<Index[]> idx(new Index[n]), idxTmp(new Index[n]);
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = invoke(proj, first[i]);
+            idx[i] = Index(i);
+        }
+        auto less = [&comp](const K& a, const K& b) { return bool(invoke(comp, a, b)); };
+        argMergeSortPingPong(keys.get(), idx.get(), keysTmp.get(), idxTmp.get(), n, false, less);
+        for (size_t i = 0; i < n; i++) pperm[i] = idx[i];
+    }
+}
+
+/**
+ * @brief Stable argsort: the permutation that sorts a range by a projected key \
+ *      (key, index) pairs are extracted once, so the sort never touches the \
+ *      elements themselves - large records cost the same as their keys. \
+ *      perm[i] is the index of the element that belongs at position i; it can \
+ *      reorder any number of parallel columns with applyPermutation().
+ * @tparam It random access iterator
+ * @tparam Comp strict ordering of keys
+ * @tparam Proj projection of an element to its key
+ * @param first first element
+ * @param last one past last element
+ * @param comp ordering instance
+ * @param proj projection instance
+ * @return permutation of [0, last - first)
+ */
+template<typename It, typename Comp = less<>, typename Proj = Identity>
+vector<size_t> argSort(It first, It last, Comp comp = Comp(), Proj proj = Proj()) {
+    size_t n = last - first;
+    vector<size_t> perm(n);
+    if (n == 1) perm[0] = 0;
+    if (n < 2) return perm;
+    // 32 bit indices keep the pairs compact whenever they can
+    if (n <= numeric_limits<uint32_t>::max()) {
+        argSortInto<uint32_t>(first, n, comp, proj, perm.data());
+    } else {
+        argSortInto<size_t>(first, n, comp, proj, perm.data());
+    }
+    return perm;
+}
+
+/**
+ * @brief argsort of a whole range
+ * @see argSort(It, It, Comp, Proj)
+ */
+template<typename Range, typename Comp = less<>, typename Proj = Identity,
+         typename = decltype(std::begin(declval<Range&>()))>
+vector<size_t> argSort(Range&& range, Comp comp = Comp(), Proj proj = Proj()) {
+    return argSort(std::begin(range), std::end(range), comp, proj);
+}
+
+/**
+ * @brief Reorder a range in place: position i receives the element at perm[i] \
+ *      every cycle of the permutation is followed once with a single temporary, \
+ *      so each element is moved exactly once. Placed positions are tracked in a \
+ *      bitmap (n/8 bytes) scanned a word at a time. A cycle of a sort permutation \
+ *      jumps across the whole range, so there is no block to keep in cache; \
+ *      instead the next element of the cycle and its permutation entry are \
+ *      prefetched while the current one moves.
+ * @tparam It random access iterator
+ * @param first first element
+ * @param pperm permutation of [0, n), not modified
+ * @param n number of elements
+ */
+template<typename It>
+void applyPermutation(It first, const size_t* pperm, size_t n) {
+    vector<uint64_t> placed((n + 63)/64, 0);
+    // positions past n count as placed
+    if (n % 64) placed.back() = ~uint64_t(0) << (n % 64);
+    for (size_t w = 0; w < placed.size(); w++) {
+        while (placed[w] != ~uint64_t(0)) {
+            size_t start = w*64 + __builtin_ctzll(~placed[w]);
+            placed[w] |= uint64_t(1) << (start % 64);
+            if (pperm[start] == start) continue;
+            auto tmp = std::move(first[start]);
+            size_t j = start;
+            for (size_t k = pperm[j]; k != start; j = k, k = pperm[k]) {
+                // the element after next and where it comes from: both are random accesses
+                if (pperm[k] != start) {
+                    __builtin_prefetch(&*(first + pperm[k]));
+                    __builtin_prefetch(pperm + pperm[k]);
+                }
+                first[j] = std::move(first[k]);
+                placed[k/64] |= uint64_t(1) << (k % 64);
+            }
+            first[j] = std::move(tmp);
+        }
+    }
+}
+
+template<typename It>
+void applyPermutation(It first, const vector<size_t>& perm) {
+    applyPermutation(first, perm.data(), perm.size());
+}
+
+/**
+ * @brief Indirect stable sort: argsort the keys, then move every element once \
+ *      meant for large records, where the merge sort would move whole elements \
+ *      on every merge level.
+ * @see argSort(It, It, Comp, Proj)
+ */
+template<typename It, typename Comp = less<>, typename Proj = Identity>
+void indirectSort(It first, It last, Comp comp = Comp(), Proj proj = Proj()) {
+    applyPermutation(first, argSort(first, last, comp, proj));
+}
+
+template<typename Range, typename Comp = less<>, typename Proj = Identity,
+         typename = decltype(std::begin(declval<Range&>()))>
+void indirectSort(Range&& range, Comp comp = Comp(), Proj proj = Proj()) {
+    indirectSort(std::begin(range), std::end(range), comp, proj);
+}
+
+/**
+ * @brief Stable sort of a random access range by a projected key \
+ *      comp orders the keys proj(element). When the key is an integer or floating \
+ *      point number ordered by std::less or std::greater a stable LSD radix sort is \
+ *      used; otherwise the merge sort runs with comp applied to the projections.
+ * @tparam It random access iterator
+ * @tparam Comp strict ordering of keys
+ * @tparam Proj projection of an element to its key
+ * @param first first element
+ * @param last one past last element
+ * @param comp ordering instance
+ * @param proj projection instance
+ */
+template<typename It, typename Comp = less<>, typename Proj = Identity>
+void stableSort(It first, It last, Comp comp = Comp(), Proj proj = Proj()) {
+    using T1 = typename iterator_traits<It>::value_type;
+    using K = decay_t<invoke_result_t<Proj&, T1&>>;
+    size_t n = last - first;
+    if (n < 2) return;
+
+    if constexpr (isRadixKey<K> && radixDirection<Comp, K>() != 0) {
+        if constexpr (is_same_v<Proj, Identity> && is_arithmetic_v<T1>) {
+            constexpr bool descending = radixDirection<Comp, K>() < 0;
+            auto bits = [&proj](const T1& v) {
+                auto u = radixBits<K>(invoke(proj, v));
+                return descending ? decltype(u)(~u) : u;
+            };
+            // the elements are their own keys - map them on the fly in every pass
+            unique_ptr<T1[]> tmp(new T1[n]);
+            if constexpr (isContiguousIterator<It>) {
+                radixSort(&*first, tmp.get(), n, bits);
+            } else {
+                unique_ptr<T1[]> buffer(new T1[n]);
+                copy(first, last, buffer.get());
+                radixSort(buffer.get(), tmp.get(), n, bits);
+                copy(buffer.get(), buffer.get() + n, first);
+            }
+        } else {
+            // sort compact (key, index) pairs, then move every element once
+            applyPermutation(first, argSort(first, last, comp, proj));
+        }
+    } else {
+        auto less = [&comp, &proj](const T1& a, const T1& b) {
+            return invoke(comp, invoke(proj, a), invoke(proj, b));
+        };
+        unique_ptr<T1[]> scratch(new T1[n]);
+        if constexpr (isContiguousIterator<It>) {
+            mergeSort(&*first, 0, n, scratch.get(), less);
+        } else {
+            // sort a contiguous copy and move it back
+            unique_ptr<T1[]> buffer(new T1[n]);
+            move(first, last, buffer.get());
+            mergeSort(buffer.get(), 0, n, scratch.get(), less);
+            move(buffer.get(), buffer.get() + n, first);
+        }
+    }
+}
+
+/**
+ * @brief Stable sort of a whole range (container, array) by a projected key
+ * @see stableSort(It, It, Comp, Proj)
+ */
+template<typename Range, typename Comp = less<>, typename Proj = Identity,
+         typename = decltype(std::begin(declval<Range&>()))>
+void stableSort(Range&& range, Comp comp = Comp(), Proj proj = Proj()) {
+    stableSort(std::begin(range), std::end(range), comp, proj);
+}
+
+/**
+ * @brief Adaptive natural merge sort (TimSort like) \
+ *      the array is scanned for existing ascending runs; strictly descending \
+ *      runs are reversed in place and runs shorter than minRun are extended with \
+ *      binary insertion sort. Runs are pushed on a stack whose lengths are kept \
+ *      balanced and neighbours are merged with galloping once one side keeps \
+ *      winning. Already sorted input costs n-1 comparisons and no allocation.
+ * @tparam T1 array type
+ */
+template<typename T1>
+class AdaptiveMergeSorter {
+public:
+    explicit AdaptiveMergeSorter(T1* parr) : parr(parr) {}
+
+    void sort(size_t n) {
+        total = n;
+        size_t minRun = minRunLength(n);
+        for (size_t lo = 0; lo < n;) {
+            size_t runLen = countRunAndMakeAscending(lo, n);
+            // extend a short run to min(minRun, remaining) elements
+            if (runLen < minRun) {
+                size_t forced = min(minRun, n - lo);
+                binaryInsertionSort(lo, lo + forced, lo + runLen);
+                runLen = forced;
+            }
+            runBases[stackSize] = lo;
+            runLens[stackSize] = runLen;
+            stackSize++;
+            mergeCollapse();
+            lo += runLen;
+        }
+        // merge all the remaining runs
+        while (stackSize > 1) {
+            size_t n2 = stackSize - 2;
+            if (n2 > 0 && runLens[n2 - 1] < runLens[n2 + 1]) n2--;
+            mergeAt(n2);
+        }
+    }
+
+private:
+    static constexpr size_t minMerge = 64;
+    static constexpr size_t minGallopInit = 7;
+    // run lengths grow at least like Fibonacci numbers - 96 covers any size_t
+    static constexpr size_t maxStack = 96;
+
+    static bool less(const T1& a, const T1& b) { return !(b <= a); }
+
+    // minRun in [minMerge/2, minMerge] so that n/minRun is (close to) a power of two
+    static size_t minRunLength(size_t n) {
+        size_t r = 0;
+        while (n >= minMerge) {
+            r |= n & 1;
+            n >>= 1;
+        }
+        return n + r;
+    }
+
+    // length of the run starting at lo; a strictly descending run is reversed
+    size_t countRunAndMakeAscending(size_t lo, size_t hi) {
+        size_t runHi = lo + 1;
+        if (runHi == hi) return 1;
+        if (less(parr[runHi++], parr[lo])) {
+            // strictly descending only - equal keys would lose their order
+            while (runHi < hi && less(parr[runHi], parr[runHi - 1])) runHi++;
+            reverse(parr + lo, parr + runHi);
+        } else {
+            while (runHi < hi && !less(parr[runHi], parr[runHi - 1])) runHi++;
+        }
+        return runHi - lo;
+    }
+
+    // parr[lo, start) is sorted - insert the rest one by one after equal keys
+    void binaryInsertionSort(size_t lo, size_t hi, size_t start) {
+        for (size_t i = start; i < hi; i++) {
+            T1 pivot = std::move(parr[i]);
+            size_t pos = upper_bound(parr + lo, parr + i, pivot, less) - parr;
+            move_backward(parr + pos, parr + i, parr + i + 1);
+            parr[pos] = std::move(pivot);
+        }
+    }
+
+    // keep runLen[i-2] > runLen[i-1] + runLen[i] and runLen[i-1] > runLen[i]
+    void mergeCollapse() {
+        while (stackSize > 1) {
+            size_t n = stackSize - 2;
+            if ((n > 0 && runLens[n - 1] <= runLens[n] + runLens[n + 1]) ||
+                (n > 1 && runLens[n - 2] <= runLens[n - 1] + runLens[n])) {
+                if (runLens[n - 1] < runLens[n + 1]) n--;
+            } else if (runLens[n] > runLens[n + 1]) {
+                break;
+            }
+            mergeAt(n);
+        }
+    }
+
+    /**
+     * @brief first index in [0, len) for which pred holds, probing 1, 3, 7, ... from the front
+     *      pred must be false...false true...true over the range
+     */
+    template<typename Pred>
+    static size_t gallopFront(size_t len, Pred pred) {
+        if (len == 0 || pred(0)) return 0;
+        size_t last = 0, ofs = 1;
+        while (ofs < len && !pred(ofs)) {
+            last = ofs;
+            ofs = 2*ofs + 1;
+        }
+        size_t lo = last + 1, hi = min(ofs, len);
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo)/2;
+            if (pred(mid)) hi = mid; else lo = mid + 1;
+        }
+        return lo;
+    }
+
+    /**
+     * @brief same as gallopFront() but probing from the back of the range
+     */
+    template<typename Pred>
+    static size_t gallopBack(size_t len, Pred pred) {
+        if (len == 0 || !pred(len - 1)) return len;
+        size_t hi = len - 1, ofs = 1;
+        while (ofs < len && pred(len - 1 - ofs)) {
+            hi = len - 1 - ofs;
+            ofs = 2*ofs + 1;
+        }
+        size_t lo = ofs < len ? len - ofs : 0;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo)/2;
+            if (pred(mid)) hi = mid; else lo = mid + 1;
+        }
+        return lo;
+    }
+
+    // merge the runs at stack positions i and i+1
+    void mergeAt(size_t i) {
+        size_t base1 = runBases[i], len1 = runLens[i];
+        size_t base2 = runBases[i + 1], len2 = runLens[i + 1];
+        runLens[i] = len1 + len2;
+        if (i == stackSize - 3) {
+            runBases[i + 1] = runBases[i + 2];
+            runLens[i + 1] = runLens[i + 2];
+        }
+        stackSize--;
+
+        // the head of run1 that is <= run2[0] is already in place
+        const T1& first2 = parr[base2];
+        size_t k = gallopFront(len1, [&](size_t j){ return less(first2, parr[base1 + j]); });
+        base1 += k;
+        len1 -= k;
+        if (len1 == 0) return;
+        // so is the tail of run2 that is >= run1[last]
+        const T1& last1 = parr[base1 + len1 - 1];
+        len2 = gallopBack(len2, [&](size_t j){ return !less(parr[base2 + j], last1); });
+        if (len2 == 0) return;
+
+        if (len1 <= len2) {
+            mergeLo(base1, len1, base2, len2);
+        } else {
+            mergeHi(base1, len1, base2, len2);
+        }
+    }
+
+    // a merge never needs more than half of the array - allocated once, on the first merge
+    T1* scratch(size_t len) {
+        if (len > scratchLen) {
+            scratchLen = max(len, total/2);
+            scratchBuff.reset(new T1[scratchLen]);
+        }
+        return scratchBuff.get();
+    }
+
+    // run1 is the shorter one - move it out and merge front to back
+    void mergeLo(size_t base1, size_t len1, size_t base2, size_t len2) {
+        T1* tmp = scratch(len1);
+        move(parr + base1, parr + base1 + len1, tmp);
+        size_t c1 = 0, c2 = base2, end2 = base2 + len2, dest = base1;
+        while (c1 < len1 && c2 < end2) {
+            // one pair at a time until a side wins minGallop times in a row
+            size_t count1 = 0, count2 = 0;
+            while (c1 < len1 && c2 < end2 && count1 < minGallop && count2 < minGallop) {
+                if (less(parr[c2], tmp[c1])) {
+                    parr[dest++] = std::move(parr[c2++]);
+                    count2++;
+                    count1 = 0;
+                } else {
+                    parr[dest++] = std::move(tmp[c1++]);
+                    count1++;
+                    count2 = 0;
+                }
+            }
+            // galloping: move whole blocks while they stay long
+            while (c1 < len1 && c2 < end2) {
+                const T1& key2 = parr[c2];
+                size_t k1 = gallopFront(len1 - c1, [&](size_t j){ return less(key2, tmp[c1 + j]); });
+                dest = move(tmp + c1, tmp + c1 + k1, parr + dest) - parr;
+                c1 += k1;
+                if (c1 == len1) break;
+                const T1& key1 = tmp[c1];
+                size_t k2 = gallopFront(end2 - c2, [&](size_t j){ return !less(parr[c2 + j], key1); });
+                dest = move(parr + c2, parr + c2 + k2, parr + dest) - parr;
+                c2 += k2;
+                if (k1 < minGallopInit && k2 < minGallopInit) {
+                    minGallop++;
+                    break;
+                }
+                if (minGallop > 1) minGallop--;
+            }
+        }
+        // a run2 remainder is already in place
+        move(tmp + c1, tmp + len1, parr + dest);
+    }
+
+    // run2 is the shorter one - move it out and merge back to front
+    void mergeHi(size_t base1, size_t len1, size_t base2, size_t len2) {
+        T1* tmp = scratch(len2);
+        move(parr + base2, parr + base2 + len2, tmp);
+        // c1 and c2 count the elements left in run1 and tmp, dest is one past the next write
+        size_t c1 = len1, c2 = len2, dest = base2 + len2;
+        while (c1 > 0 && c2 > 0) {
+            size_t count1 = 0, count2 = 0;
+            while (c1 > 0 && c2 > 0 && count1 < minGallop && count2 < minGallop) {
+                if (less(tmp[c2 - 1], parr[base1 + c1 - 1])) {
+                    parr[--dest] = std::move(parr[base1 + --c1]);
+                    count1++;
+                    count2 = 0;
+                } else {
+                    parr[--dest] = std::move(tmp[--c2]);
+                    count2++;
+                    count1 = 0;
+                }
+            }
+            while (c1 > 0 && c2 > 0) {
+                // run1 elements greater than the last of tmp go first
+                const T1& key2 = tmp[c2 - 1];
+                size_t k1 = c1 - gallopBack(c1, [&](size_t j){ return less(key2, parr[base1 + j]); });
+                dest = move_backward(parr + base1 + c1 - k1, parr + base1 + c1, parr + dest) - parr;
+                c1 -= k1;
+                if (c1 == 0) break;
+                // then tmp elements not less than the last of run1
+                const T1& key1 = parr[base1 + c1 - 1];
+                size_t k2 = c2 - gallopBack(c2, [&](size_t j){ return !less(tmp[j], key1); });
+                dest = move_backward(tmp + c2 - k2, tmp + c2, parr + dest) - parr;
+                c2 -= k2;
+                if (k1 < minGallopInit && k2 < minGallopInit) {
+                    minGallop++;
+                    break;
+                }
+                if (minGallop > 1) minGallop--;
+            }
+        }
+        // a run1 remainder is already in place
+        move_backward(tmp, tmp + c2, parr + dest);
+    }
+
+    T1* parr;
+    size_t total = 0;
+    size_t runBases[maxStack];
+    size_t runLens[maxStack];
+    size_t stackSize = 0;
+    size_t minGallop = minGallopInit;
+    unique_ptr<T1[]> scratchBuff;
+    size_t scratchLen = 0;
+};
+
+/**
+ * @brief Adaptive natural merge sort \
+ *      stable; O(n) and allocation free on already sorted or reverse sorted input, \
+ *      O(n log n) in the worst case.
+ * @tparam T1 array type
+ * @param parr pointer to array to sort
+ * @param begin starting offset 
+ * @param end ending offset (one past last)
+ */
+template<typename T1>
+void adaptiveMergeSort(T1* parr, size_t begin, size_t end) {
+    if (begin >= end || end - begin < 2) return;
+    AdaptiveMergeSorter<T1>(parr + begin).sort(end - begin);
+}
+
+/**
+ * @brief Small fork/join work stealing thread pool \
+ *      every worker owns a deque of tasks: it pushes and pops at the back \
+ *      (newest, cache hot task first) while idle workers steal from the front \
+ *      (oldest, usually the biggest chunk of work). Threads which are not pool \
+ *      workers submit into one extra shared deque. \
+ *      wait() never blocks idle - the waiting thread keeps running tasks until \
+ *      its group is done, so nested fork/join cannot dead lock the pool.
+ */
+class TaskPool {
+public:
+    using Task = function<void()>;
+
+    /**
+     * @brief Join counter for a set of spawned tasks
+     */
+    struct Group {
+        atomic<size_t> pending{0};
+    };
+
+    explicit TaskPool(unsigned workers = thread::hardware_concurrency()) {
+        if (workers == 0) workers = 1;
+        // one deque per worker plus the shared deque for outside threads
+        for (unsigned i = 0; i <= workers; i++) {
+            queues.emplace_back(new Queue);
+        }
+        for (unsigned i = 0; i < workers; i++) {
+            threads.emplace_back([this, i](){ workerLoop(i); });
+        }
+    }
+
+    ~TaskPool() {
+        {
+            lock_guard<mutex> lk(idleLock);
+            stop = true;
+        }
+        idleCv.notify_all();
+        for (auto& tx : threads) {
+            if (tx.joinable()) tx.join();
+        }
+    }
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    /**
+     * @brief number of worker threads
+     */
+    size_t size() const { return threads.size(); }
+
+    /**
+     * @brief Queue a task on the calling thread's deque and account it in the group
+     *      tasks must not throw
+     * @param group join counter the task belongs to
+     * @param task callable to run
+     */
+    void spawn(Group& group, Task task) {
+        group.pending.fetch_add(1, memory_order_relaxed);
+        Queue& q = *queues[selfIndex()];
+        {
+            lock_guard<mutex> lk(q.lock);
+            q.tasks.emplace_back([&group, task = std::move(task)](){
+                task();
+                group.pending.fetch_sub(1, memory_order_release);
+            });
+        }
+        // counted under idleLock: a worker checks queued under it before it sleeps
+        {
+            lock_guard<mutex> lk(idleLock);
+            queued.fetch_add(1, memory_order_release);
+        }
+        idleCv.notify_one();
+    }
+
+    /**
+     * @brief Help running tasks until every task of the group has finished
+     * @param group join counter to wait for
+     */
+    void wait(Group& group) {
+        size_t self = selfIndex();
+        while (group.pending.load(memory_order_acquire) != 0) {
+            if (!runOne(self)) this_thread::yield();
+        }
+    }
+
+private:
+    struct Queue {
+        mutex lock;
+        deque<Task> tasks;
+    };
+
+    // index of the deque owned by the calling thread
+    size_t selfIndex() const {
+        return tlsPool == this ? tlsIndex : threads.size();
+    }
+
+    bool popBack(size_t idx, Task& task) {
+        Queue& q = *queues[idx];
+        lock_guard<mutex> lk(q.lock);
+        if (q.tasks.empty()) return false;
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool stealFront(size_t idx, Task& task) {
+        Queue& q = *queues[idx];
+        unique_lock<mutex> lk(q.lock, try_to_lock);
+        if (!lk.owns_lock() || q.tasks.empty()) return false;
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        return true;
+    }
+
+    // run one task: own deque first, then steal round robin starting next door
+    bool runOne(size_t self) {
+        if (queued.load(memory_order_acquire) == 0) return false;
+        Task task;
+        bool found = popBack(self, task);
+        for (size_t i = 1; !found && i < queues.size(); i++) {
+            found = stealFront((self + i) % queues.size(), task);
+        }
+        if (!found) return false;
+        queued.fetch_sub(1, memory_order_relaxed);
+        task();
+        return true;
+    }
+
+    void workerLoop(size_t self) {
+        tlsPool = this;
+        tlsIndex = self;
+        while (!stop) {
+            if (runOne(self)) continue;
+            unique_lock<mutex> lk(idleLock);
+            idleCv.wait(lk, [this](){
+                return stop || queued.load(memory_order_acquire) != 0;
+            });
+        }
+    }
+
+    vector<unique_ptr<Queue>> queues;
+    vector<thread> threads;
+    atomic<bool> stop{false};
+    atomic<size_t> queued{0};
+    mutex idleLock;
+    condition_variable idleCv;
+    inline static thread_local const TaskPool* tlsPool = nullptr;
+    inline static thread_local size_t tlsIndex = 0;
+};
+
+/**
+ * @brief Co-rank of a position in the merged output \
+ *      finds how many elements of the left range come among the first k \
+ *      elements of the stable merge of left and right (ties go left).
+ * @tparam T1 array type
+ * @param k output position
+ * @param pleft left sorted range
+ * @param leftHalf number of elements in the left range
+ * @param pright right sorted range
+ * @param rightHalf number of elements in the right range
+ * @return number of left elements in the first k merged elements
+ */
+template<typename T1>
+size_t mergeCoRank(size_t k, const T1* pleft, size_t leftHalf, const T1* pright, size_t rightHalf) {
+    size_t lo = k > rightHalf ? k - rightHalf : 0;
+    size_t hi = k < leftHalf ? k : leftHalf;
+    // smallest i such that pleft[i] is not taken before pright[k - i - 1]
+    while (lo < hi) {
+        size_t i = lo + (hi - lo)/2;
+        if (pleft[i] <= pright[k - i - 1]) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Merge two sorted ranges with several workers \
+ *      the output is cut into equal chunks, each chunk finds its starting point \
+ *      in both inputs by co-ranking and merges sequentially. The result is exactly \
+ *      the one of mergeRanges().
+ * @tparam T1 array type
+ * @param pool task pool to run on
+ * @param pleft left sorted range
+ * @param leftHalf number of elements in the left range
+ * @param pright right sorted range
+ * @param rightHalf number of elements in the right range
+ * @param dst destination of (leftHalf + rightHalf) elements
+ * @param grain minimal number of output elements per chunk
+ */
+template<typename T1>
+void parallelMergeRanges(TaskPool& pool, T1* pleft, size_t leftHalf, T1* pright, size_t rightHalf,
+                         T1* dst, size_t grain) {
+    size_t n = leftHalf + rightHalf;
+    size_t chunks = min(n/max<size_t>(grain, 1), 4*(pool.size() + 1));
+    if (chunks < 2) {
+        mergeRanges(pleft, leftHalf, pright, rightHalf, dst);
+        return;
+    }
+    // all split points are found before any chunk starts moving elements away
+    size_t chunk = (n + chunks - 1)/chunks;
+    vector<size_t> splits;
+    for (size_t k = 0; k < n; k += chunk) {
+        splits.push_back(mergeCoRank(k, pleft, leftHalf, pright, rightHalf));
+    }
+    splits.push_back(leftHalf);
+    TaskPool::Group group;
+    for (size_t c = 0, k = 0; k < n; c++, k += chunk) {
+        size_t kEnd = min(k + chunk, n);
+        size_t i0 = splits[c], i1 = splits[c + 1];
+        pool.spawn(group, [=](){
+            mergeRanges(pleft + i0, i1 - i0, pright + (k - i0), (kEnd - i1) - (k - i0), dst + k);
+        });
+    }
+    pool.wait(group);
+}
+
+/**
+ * @brief Parallel ping-pong recursion of the merge sort \
+ *      same buffer discipline as mergeSortPingPong(); the left half is forked as \
+ *      a task while the calling thread sorts the right half. Ranges up to grain \
+ *      elements are sorted sequentially.
+ * @tparam T1 array type
+ * @param pool task pool to run on
+ * @param parr pointer to array to sort
+ * @param pscratch pointer to scratch buffer of n elements
+ * @param n number of elements
+ * @param toScratch true - result goes into pscratch; false - result goes into parr
+ * @param grain sequential cut off
+ */
+template<typename T1>
+void parallelMergeSortPingPong(TaskPool& pool, T1* parr, T1* pscratch, size_t n, bool toScratch, size_t grain) {
+    if (n <= grain) {
+        mergeSortPingPong(parr, pscratch, n, toScratch);
+        return;
+    }
+    size_t m = n/2;
+    TaskPool::Group group;
+    pool.spawn(group, [=, &pool](){
+        parallelMergeSortPingPong(pool, parr, pscratch, m, !toScratch, grain);
+    });
+    parallelMergeSortPingPong(pool, parr + m, pscratch + m, n - m, !toScratch, grain);
+    pool.wait(group);
+    if (toScratch) {
+        parallelMergeRanges(pool, parr, m, parr + m, n - m, pscratch, grain);
+    } else {
+        parallelMergeRanges(pool, pscratch, m, pscratch + m, n - m, parr, grain);
+    }
+}
+
+/**
+ * @brief Parallel divide and conquer merge sort \
+ *      forks both halves on the work stealing pool and merges in parallel. \
+ *      The result is identical to the sequential stable mergeSort().
+ * @tparam T1 array type
+ * @param pool task pool to run on
+ * @param parr pointer to array to sort
+ * @param begin starting offset 
+ * @param end ending offset (one past last)
+ * @param grain ranges of up to grain elements are sorted sequentially
+ */
+template<typename T1>
+void parallelMergeSort(TaskPool& pool, T1* parr, size_t begin, size_t end, size_t grain = 1 << 14) {
+    if (begin >= end || end - begin < 2) return;
+    size_t n = end - begin;
+    if (grain < 2) grain = 2;
+    if (n <= grain) {
+        mergeSort(parr, begin, end);
+        return;
+    }
+    unique_ptr<T1[]> scratch(new T1[n]);
+    parallelMergeSortPingPong(pool, parr + begin, scratch.get(), n, false, grain);
+}
+
+
+/**
+ * @brief External memory merge sort settings
+ */
+struct ExternalSortOptions {
+    // bytes used for run formation (records + scratch) and for the merge buffers
+    size_t memoryBudget = size_t(256) << 20;
+    // directory for the temporary run files
+    string tempDir = "/tmp";
+    // maximal number of runs merged in one pass
+    size_t fanIn = 64;
+    // bytes of each of the two output buffers used while merging
+    size_t writeBuffer = size_t(8) << 20;
+};
+
+/**
+ * @brief Read up to bytes from fd at offset, retrying short reads
+ * @return number of bytes read - less than requested only at end of file
+ */
+inline size_t preadFully(int fd, void* pbuf, size_t bytes, off_t offset) {
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t r = pread(fd, static_cast<char*>(pbuf) + done, bytes - done, offset + done);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            throw system_error(errno, generic_category(), "external sort read");
+        }
+        if (r == 0) break;
+        done += r;
+    }
+    return done;
+}
+
+/**
+ * @brief Write all bytes to fd, retrying partial writes
+ */
+inline void writeFully(int fd, const void* pbuf, size_t bytes) {
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t w = write(fd, static_cast<const char*>(pbuf) + done, bytes - done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            throw system_error(errno, generic_category(), "external sort write");
+        }
+        done += w;
+    }
+}
+
+/**
+ * @brief Sorted run spilled to an anonymous temporary file \
+ *      the file is unlinked right after creation - it goes away with the descriptor.
+ */
+class SortRun {
+public:
+    SortRun(const string& tempDir) {
+        string path = tempDir + "/merge_sort_run_XXXXXX";
+        fd = mkstemp(&path[0]);
+        if (fd < 0) throw system_error(errno, generic_category(), "external sort temp file " + path);
+        unlink(path.c_str());
+    }
+    ~SortRun() { if (fd >= 0) close(fd); }
+    SortRun(SortRun&& other) : fd(other.fd), count(other.count) { other.fd = -1; }
+    SortRun(const SortRun&) = delete;
+    SortRun& operator=(const SortRun&) = delete;
+    SortRun& operator=(SortRun&&) = delete;
+
+    int fd;
+    size_t count = 0; // number of records
+};
+
+/**
+ * @brief Sequential buffered reader of a run of fixed width records
+ * @tparam T1 record type
+ */
+template<typename T1>
+class RunReader {
+public:
+    RunReader(int fd, size_t count, size_t bufferRecords)
+        : fd(fd), remaining(count), buffer(max<size_t>(bufferRecords, 1)) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        refill();
+    }
+    bool empty() const { return pos == len; }
+    const T1& head() const { return buffer[pos]; }
+    void pop() { if (++pos == len) refill(); }
+
+private:
+    void refill() {
+        size_t want = min(remaining, buffer.size());
+        size_t got = preadFully(fd, buffer.data(), want*sizeof(T1), offset);
+        if (got != want*sizeof(T1)) throw runtime_error("external sort: run file truncated");
+        offset += got;
+        remaining -= want;
+        pos = 0;
+        len = want;
+    }
+
+    int fd;
+    size_t remaining;
+    off_t offset = 0;
+    vector<T1> buffer;
+    size_t pos = 0, len = 0;
+};
+
+/**
+ * @brief Double buffered writer of fixed width records \
+ *      one buffer is filled while the other one is written in the background, \
+ *      by one writer thread that lives as long as the writer.
+ * @tparam T1 record type
+ */
+template<typename T1>
+class AsyncRunWriter {
+public:
+    AsyncRunWriter(int fd, size_t bufferRecords) : fd(fd) {
+        buffers[0].reserve(max<size_t>(bufferRecords, 1));
+        buffers[1].reserve(max<size_t>(bufferRecords, 1));
+        writerThread = thread([this](){ writeLoop(); });
+    }
+    ~AsyncRunWriter() {
+        // finish() reports errors - here we only make sure nothing is left running
+        {
+            lock_guard<mutex> lk(lock);
+            stop = true;
+        }
+        cv.notify_all();
+        writerThread.join();
+    }
+
+    AsyncRunWriter(const AsyncRunWriter&) = delete;
+    AsyncRunWriter& operator=(const AsyncRunWriter&) = delete;
+
+    void push(const T1& rec) {
+        vector<T1>& b = buffers[cur];
+        b.push_back(rec);
+        if (b.size() == b.capacity()) flush();
+    }
+
+    void finish() {
+        flush();
+        unique_lock<mutex> lk(lock);
+        waitWritten(lk);
+    }
+
+private:
+    // the other buffer must be written before we can hand this one out
+    void flush() {
+        if (buffers[cur].empty()) return;
+        {
+            unique_lock<mutex> lk(lock);
+            waitWritten(lk);
+            pending = &buffers[cur];
+        }
+        cv.notify_all();
+        cur ^= 1;
+    }
+
+    // lock held: wait for the buffer in writing, rethrow what writing it threw
+    void waitWritten(unique_lock<mutex>& lk) {
+        cv.wait(lk, [this](){ return pending == nullptr; });
+        if (error) rethrow_exception(exchange(error, nullptr));
+    }
+
+    void writeLoop() {
+        unique_lock<mutex> lk(lock);
+        for (;;) {
+            cv.wait(lk, [this](){ return stop || pending != nullptr; });
+            if (!pending) return;
+            vector<T1>* pb = pending;
+            lk.unlock();
+            exception_ptr failed;
+            try {
+                writeFully(fd, pb->data(), pb->size()*sizeof(T1));
+            } catch (...) {
+                failed = current_exception();
+            }
+            pb->clear();
+            lk.lock();
+            error = failed;
+            pending = nullptr;
+            cv.notify_all();
+        }
+    }
+
+    int fd;
+    vector<T1> buffers[2];
+    int cur = 0;
+    mutex lock;
+    condition_variable cv;
+    vector<T1>* pending = nullptr;      // handed to the writer thread, not written yet
+    exception_ptr error;                // of the last write
+    bool stop = false;
+    thread writerThread;
+};
+
+/**
+ * @brief Tournament tree of losers over k sources \
+ *      the root holds the winning (smallest) source; after the winner advances \
+ *      only the log2(k) losers on its leaf to root path are replayed.
+ * @tparam Less strict ordering of two source indices
+ */
+template<typename Less>
+class LoserTree {
+public:
+    LoserTree(size_t k, Less less) : k(k), tree(max<size_t>(k, 1)), less(less) {
+        vector<size_t> winners(2*k);
+        for (size_t i = 0; i < k; i++) winners[k + i] = i;
+        for (size_t node = k - 1; node >= 1; node--) {
+            size_t a = winners[2*node], b = winners[2*node + 1];
+            if (less(b, a)) swap(a, b);
+            winners[node] = a;
+            tree[node] = b;
+        }
+        tree[0] = k > 1 ? winners[1] : 0;
+    }
+
+    size_t winner() const { return tree[0]; }
+
+    // the winner source has advanced - play it back up to the root
+    void replay() {
+        size_t s = tree[0];
+        for (size_t node = (s + k)/2; node >= 1; node /= 2) {
+            if (less(tree[node], s)) swap(tree[node], s);
+        }
+        tree[0] = s;
+    }
+
+private:
+    size_t k;
+    vector<size_t> tree;
+    Less less;
+};
+
+/**
+ * @brief k-way merge of sorted runs into fd \
+ *      ties are resolved by run order, which keeps the sort stable.
+ * @tparam T1 record type
+ * @return number of records written
+ */
+template<typename T1>
+size_t mergeRuns(SortRun* pruns, size_t k, int fd, size_t readRecords, size_t writeRecords) {
+    if (k == 0) return 0;
+    vector<RunReader<T1>> readers;
+    readers.reserve(k);
+    for (size_t i = 0; i < k; i++) {
+        readers.emplace_back(pruns[i].fd, pruns[i].count, readRecords);
+    }
+    auto less = [&readers](size_t a, size_t b) {
+        if (readers[a].empty()) return false;
+        if (readers[b].empty()) return true;
+        const T1& x = readers[a].head();
+        const T1& y = readers[b].head();
+        return a < b ? x <= y : !(y <= x);
+    };
+    LoserTree<decltype(less)> tree(k, less);
+    AsyncRunWriter<T1> writer(fd, writeRecords);
+    size_t written = 0;
+    for (size_t w = tree.winner(); !readers[w].empty(); w = tree.winner()) {
+        writer.push(readers[w].head());
+        readers[w].pop();
+        tree.replay();
+        written++;
+    }
+    writer.finish();
+    return written;
+}
+
+/**
+ * @brief External memory merge sort of a file of fixed width records \
+ *      the input is streamed in chunks that fit the memory budget, each chunk is \
+ *      sorted with mergeSort() and spilled as a run, then the runs are merged \
+ *      fanIn at a time with a loser tree until one pass writes the output.
+ * @tparam T1 record type (trivially copyable, ordered by <=)
+ * @param inputPath file of sizeof(T1) records
+ * @param outputPath sorted output file (created or truncated)
+ * @param opt memory budget, temp directory and fan in
+ */
+template<typename T1>
+void externalMergeSort(const string& inputPath, const string& outputPath,
+                       const ExternalSortOptions& opt = ExternalSortOptions()) {
+    static_assert(is_trivially_copyable_v<T1>, "external sort works on fixed width records");
+    size_t fanIn = max<size_t>(opt.fanIn, 2);
+
+    int in = open(inputPath.c_str(), O_RDONLY);
+    if (in < 0) throw system_error(errno, generic_category(), "external sort open " + inputPath);
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // run formation: half of the budget for the records, half for the merge scratch
+    vector<SortRun> runs;
+    try {
+        size_t chunk = max<size_t>(opt.memoryBudget/(2*sizeof(T1)), 1);
+        unique_ptr<T1[]> data(new T1[chunk]), scratch(new T1[chunk]);
+        off_t offset = 0;
+        for (;;) {
+            size_t got = preadFully(in, data.get(), chunk*sizeof(T1), offset);
+            size_t n = got/sizeof(T1);
+            if (n == 0) break;
+            offset += got;
+            mergeSort(data.get(), 0, n, scratch.get());
+            runs.emplace_back(opt.tempDir);
+            writeFully(runs.back().fd, data.get(), n*sizeof(T1));
+            runs.back().count = n;
+            if (got < chunk*sizeof(T1)) break;
+        }
+    } catch (...) {
+        close(in);
+        throw;
+    }
+    close(in);
+
+    // merge buffers: two output buffers, the rest split between the inputs
+    size_t writeBytes = min(opt.writeBuffer, opt.memoryBudget/8);
+    size_t writeRecords = max<size_t>(writeBytes/sizeof(T1), 1);
+    size_t readRecords = max<size_t>((opt.memoryBudget - 2*writeBytes)/(fanIn*sizeof(T1)), 1);
+
+    // intermediate passes until a single pass can produce the output
+    while (runs.size() > fanIn) {
+        vector<SortRun> merged;
+        for (size_t first = 0; first < runs.size(); first += fanIn) {
+            size_t k = min(fanIn, runs.size() - first);
+            merged.emplace_back(opt.tempDir);
+            merged.back().count = mergeRuns<T1>(&runs[first], k, merged.back().fd, readRecords, writeRecords);
+        }
+        runs = std::move(merged);
+    }
+
+    int out = open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) throw system_error(errno, generic_category(), "external sort open " + outputPath);
+    try {
+        mergeRuns<T1>(runs.data(), runs.size(), out, readRecords, writeRecords);
+    } catch (...) {
+        close(out);
+        throw;
+    }
+    close(out);
+}
+
+#endif // _MERGE_SORT_HXX_
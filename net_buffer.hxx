@@ -0,0 +1,307 @@
+/**
+ * @file net_buffer.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Connection buffers for the network demos: a per thread pool of size
+ *      classed blocks with refcounted slices, and the per connection output
+ *      ring that coalesces replies into one sendmsg and bounds what a slow
+ *      reader can make the server hold. Connections hold blocks only while
+ *      they have bytes buffered, so memory follows the active connections.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_BUFFER_HXX_
+#define _NET_BUFFER_HXX_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+class buffer_pool;
+
+/**
+ * Header of a pooled block, the data follows it. The refcount is not atomic:
+ * a block and its slices stay on the thread of its pool.
+ */
+struct buf_block {
+    buffer_pool* pool;
+    size_t cap;
+    uint32_t refs;
+    int cls;                    // size class, -1: larger than any class - freed on release
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+/**
+ * @brief Blocks of 4 KiB << class, recycled through one free list per class. \
+ *      Steady state traffic never reaches malloc; idle blocks past keep_bytes \
+ *      are freed instead of kept. One pool per thread (local()), blocks and \
+ *      slices must not outlive it or leave its thread.
+ */
+class buffer_pool {
+public:
+    static constexpr size_t min_block = 4096;
+    static constexpr int classes = 14;              // 4 KiB .. 32 MiB
+
+    explicit buffer_pool(size_t keep_bytes = size_t(64) << 20) : keep_bytes_(keep_bytes) {}
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+    ~buffer_pool() {
+        for (auto& head : free_) {
+            while (head) {
+                buf_block* next = next_of(head);
+                free(head);
+                head = next;
+            }
+        }
+    }
+
+    static buffer_pool& local() {
+        thread_local buffer_pool pool;
+        return pool;
+    }
+
+    /**
+     * @return a block of at least min_size bytes with one reference
+     */
+    buf_block* acquire(size_t min_size) {
+        int cls = class_of(min_size);
+        buf_block* b;
+        if (cls >= 0 && free_[cls]) {
+            b = free_[cls];
+            free_[cls] = next_of(b);
+            idle_bytes_ -= b->cap;
+        } else {
+            size_t cap = cls >= 0 ? min_block << cls : min_size;
+            void* mem = malloc(sizeof(buf_block) + cap);
+            if (!mem) throw bad_alloc();
+            b = static_cast<buf_block*>(mem);
+            b->pool = this;
+            b->cap = cap;
+            b->cls = cls;
+            held_bytes_ += cap;
+        }
+        b->refs = 1;
+        return b;
+    }
+
+    /**
+     * @brief Take back a block without references
+     */
+    void release(buf_block* b) {
+        if (b->cls >= 0 && idle_bytes_ + b->cap <= keep_bytes_) {
+            next_of(b) = free_[b->cls];
+            free_[b->cls] = b;
+            idle_bytes_ += b->cap;
+            return;
+        }
+        held_bytes_ -= b->cap;
+        free(b);
+    }
+
+    size_t held_bytes() const { return held_bytes_; }      // allocated, in use or idle
+    size_t idle_bytes() const { return idle_bytes_; }      // on the free lists
+
+private:
+    static int class_of(size_t n) {
+        for (int cls = 0; cls < classes; cls++) {
+            if (n <= min_block << cls) return cls;
+        }
+        return -1;
+    }
+    // a free block keeps the link in its data
+    static buf_block*& next_of(buf_block* b) { return *reinterpret_cast<buf_block**>(b->data()); }
+
+    buf_block* free_[classes] = {};
+    size_t keep_bytes_;
+    size_t held_bytes_ = 0;
+    size_t idle_bytes_ = 0;
+};
+
+inline void buf_unref(buf_block* b) {
+    if (b && --b->refs == 0) b->pool->release(b);
+}
+
+/**
+ * @brief Bytes inside a pooled block, keeping the block alive - a handler holds on \
+ *      to received data this way instead of copying it.
+ */
+class buf_slice {
+public:
+    buf_slice() = default;
+    buf_slice(buf_block* b, const char* p, size_t n) : b_(b), p_(p), n_(n) {
+        if (b_) b_->refs++;
+    }
+    buf_slice(const buf_slice& o) : buf_slice(o.b_, o.p_, o.n_) {}
+    buf_slice(buf_slice&& o) noexcept : b_(o.b_), p_(o.p_), n_(o.n_) { o.b_ = nullptr; }
+    buf_slice& operator=(buf_slice o) noexcept {
+        swap(b_, o.b_);
+        swap(p_, o.p_);
+        swap(n_, o.n_);
+        return *this;
+    }
+    ~buf_slice() { buf_unref(b_); }
+
+    /**
+     * @brief A slice of a fresh block holding a copy of the bytes
+     */
+    static buf_slice copy_of(string_view s, buffer_pool& pool = buffer_pool::local()) {
+        buf_block* b = pool.acquire(max<size_t>(s.size(), 1));
+        if (!s.empty()) memcpy(b->data(), s.data(), s.size());
+        buf_slice slice(b, b->data(), s.size());
+        buf_unref(b);
+        return slice;
+    }
+
+    const char* data() const { return p_; }
+    size_t size() const { return n_; }
+    bool empty() const { return n_ == 0; }
+    string_view view() const { return string_view(p_, n_); }
+
+private:
+    buf_block* b_ = nullptr;
+    const char* p_ = nullptr;
+    size_t n_ = 0;
+};
+
+enum class flush_result { drained, blocked, error };
+
+/**
+ * @brief Pending output of one connection, a byte ring. \
+ *      Replies are appended while an event loop pass runs and leave together \
+ *      in one sendmsg (two iovecs when the data wraps). Whatever the kernel \
+ *      does not take stays queued for EPOLLOUT. The ring is a pool block taken \
+ *      when output is queued and given back once it is sent; it grows by \
+ *      doubling up to a hard limit - past it append() fails and the caller \
+ *      drops the slow reader.
+ */
+class out_ring {
+public:
+    explicit out_ring(size_t limit = size_t(1) << 20) : limit_(limit) {}
+    out_ring(out_ring&& o) noexcept
+        : blk_(o.blk_), cap_(o.cap_), head_(o.head_), tail_(o.tail_), limit_(o.limit_) {
+        o.blk_ = nullptr;
+        o.cap_ = 0;
+        o.head_ = o.tail_ = 0;
+    }
+    out_ring& operator=(out_ring&& o) noexcept {
+        if (this != &o) {
+            reset();
+            swap(blk_, o.blk_);
+            swap(cap_, o.cap_);
+            swap(head_, o.head_);
+            swap(tail_, o.tail_);
+            limit_ = o.limit_;
+        }
+        return *this;
+    }
+    ~out_ring() { reset(); }
+
+    /**
+     * @return false when the bytes would take the ring past its limit
+     */
+    bool append(const void* data, size_t n) {
+        if (n == 0) return true;
+        if (size() + n > cap_ && !grow(size() + n)) return false;
+        size_t at = tail_ & (cap_ - 1);
+        size_t first = min(n, cap_ - at);
+        memcpy(blk_->data() + at, data, first);
+        memcpy(blk_->data(), static_cast<const char*>(data) + first, n - first);
+        tail_ += n;
+        return true;
+    }
+
+    size_t size() const { return size_t(tail_ - head_); }
+    bool empty() const { return tail_ == head_; }
+
+    /**
+     * @brief The queued bytes as at most two iovecs
+     * @return number of iovecs used
+     */
+    int fill_iov(iovec* iov) const {
+        if (empty()) return 0;
+        size_t at = head_ & (cap_ - 1);
+        size_t first = min(size(), cap_ - at);
+        iov[0] = iovec{blk_->data() + at, first};
+        if (first == size()) return 1;
+        iov[1] = iovec{blk_->data(), size() - first};
+        return 2;
+    }
+
+    void consume(size_t n) {
+        head_ += n;
+        // an idle connection holds no memory, the block goes back to the pool
+        if (empty()) reset();
+    }
+
+    /**
+     * @brief Send what the socket takes now
+     * @param more MSG_MORE - further replies follow right away, hold the partial segment
+     * @param sent if given, the bytes written are added to it
+     */
+    flush_result flush(int fd, bool more = false, uint64_t* sent = nullptr) {
+        while (!empty()) {
+            iovec iov[2];
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = size_t(fill_iov(iov));
+            ssize_t r = sendmsg(fd, &msg, MSG_NOSIGNAL|MSG_DONTWAIT|(more ? MSG_MORE : 0));
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN ? flush_result::blocked : flush_result::error;
+            }
+            if (sent) *sent += uint64_t(r);
+            consume(size_t(r));
+        }
+        return flush_result::drained;
+    }
+
+    void reset() {
+        buf_unref(blk_);
+        blk_ = nullptr;
+        cap_ = 0;
+        head_ = tail_ = 0;
+    }
+
+private:
+    bool grow(size_t need) {
+        if (need > limit_) return false;
+        size_t cap = max<size_t>(cap_*2, buffer_pool::min_block);
+        while (cap < need) cap *= 2;
+        // pool classes are powers of 2, the ring uses exactly what it asked for
+        buf_block* blk = buffer_pool::local().acquire(cap);
+        // linearize the queued bytes at the front of the new ring
+        iovec iov[2];
+        int cnt = fill_iov(iov);
+        size_t len = 0;
+        for (int i = 0; i < cnt; i++) {
+            memcpy(blk->data() + len, iov[i].iov_base, iov[i].iov_len);
+            len += iov[i].iov_len;
+        }
+        buf_unref(blk_);
+        blk_ = blk;
+        cap_ = cap;
+        head_ = 0;
+        tail_ = len;
+        return true;
+    }
+
+    buf_block* blk_ = nullptr;
+    size_t cap_ = 0;            // a power of 2
+    uint64_t head_ = 0, tail_ = 0;
+    size_t limit_;
+};
+
+#endif // _NET_BUFFER_HXX_
@@ -0,0 +1,459 @@
+/**
+ * @file net_client.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Client side of the network demos: resolved addresses cached with a TTL,
+ *      a non blocking connect racing the candidate addresses Happy Eyeballs style
+ *      (RFC 8305 - families interleaved, the next attempt starts after a short
+ *      delay or as soon as one fails, the first to complete wins) under an overall
+ *      timeout, and a pool of keep-alive connections per endpoint on which
+ *      requests are pipelined - a client opening thousands of short sessions pays
+ *      for resolution and handshakes once per connection it keeps, not per session.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_CLIENT_HXX_
+#define _NET_CLIENT_HXX_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "net_frame.hxx"
+#include "net_log.hxx"
+
+using namespace std;
+
+inline int64_t client_now_ms() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct client_options {
+    int resolve_ttl_ms = 30000;         // resolved addresses are used this long
+    int connect_timeout_ms = 3000;      // for all the attempts of a connect together
+    int attempt_delay_ms = 250;         // the next address is tried after this (RFC 8305 recommends 250)
+    int idle_ttl_ms = 5000;             // pooled connections idle longer are closed - keep below the server's idle timeout
+    size_t max_idle = 64;               // pooled connections per endpoint
+    frame_mode framing = frame_mode::length_prefixed;
+    uint32_t max_frame = frame_default_max;
+};
+
+/**
+ * One resolved address
+ */
+struct client_addr {
+    sockaddr_storage sa;
+    socklen_t len;
+};
+
+/**
+ * @brief Resolved addresses per host and port, thread safe. A lookup runs \
+ *      getaddrinfo only when the entry is missing or older than the TTL; the \
+ *      lookup itself runs outside the lock. The addresses come interleaved by \
+ *      family, the resolver's first choice first (RFC 8305 section 4).
+ */
+class addr_cache {
+public:
+    explicit addr_cache(int ttl_ms = 30000) : ttl_ms_(ttl_ms) {}
+
+    /**
+     * @return 0, or the getaddrinfo error (gai_strerror)
+     */
+    int resolve(const string& host, int port, vector<client_addr>& out) {
+        string key = host + ' ' + to_string(port);
+        int64_t now = client_now_ms();
+        {
+            lock_guard<mutex> lk(lock_);
+            auto it = entries_.find(key);
+            if (it != entries_.end() && it->second.expires > now) {
+                out = it->second.addrs;
+                hits_.fetch_add(1, memory_order_relaxed);
+                return 0;
+            }
+        }
+        misses_.fetch_add(1, memory_order_relaxed);
+        addrinfo hints, *res;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        int rc = getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &res);
+        if (rc != 0) return rc;
+        vector<client_addr> addrs;
+        for (addrinfo* rp = res; rp; rp = rp->ai_next) {
+            client_addr a;
+            memset(&a.sa, 0, sizeof(a.sa));
+            memcpy(&a.sa, rp->ai_addr, rp->ai_addrlen);
+            a.len = rp->ai_addrlen;
+            addrs.push_back(a);
+        }
+        freeaddrinfo(res);
+        interleave(addrs);
+        lock_guard<mutex> lk(lock_);
+        entries_[key] = entry{addrs, now + ttl_ms_};
+        out = move(addrs);
+        return 0;
+    }
+
+    /**
+     * @brief Forget an entry - e.g. when none of its addresses could be connected
+     */
+    void invalidate(const string& host, int port) {
+        lock_guard<mutex> lk(lock_);
+        entries_.erase(host + ' ' + to_string(port));
+    }
+
+    uint64_t hits() const { return hits_.load(memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(memory_order_relaxed); }
+
+private:
+    struct entry {
+        vector<client_addr> addrs;
+        int64_t expires;
+    };
+
+    /**
+     * @brief Alternate the families, starting with the first one - stable within a family
+     */
+    static void interleave(vector<client_addr>& addrs) {
+        if (addrs.empty()) return;
+        sa_family_t first = addrs[0].sa.ss_family;
+        vector<client_addr> a, b;
+        for (auto& x : addrs) (x.sa.ss_family == first ? a : b).push_back(x);
+        addrs.clear();
+        for (size_t i = 0; i < max(a.size(), b.size()); i++) {
+            if (i < a.size()) addrs.push_back(a[i]);
+            if (i < b.size()) addrs.push_back(b[i]);
+        }
+    }
+
+    int ttl_ms_;
+    mutex lock_;
+    unordered_map<string, entry> entries_;
+    atomic_uint64_t hits_{0};
+    atomic_uint64_t misses_{0};
+};
+
+/**
+ * @brief Connect to the first address that answers. Attempts are non blocking and \
+ *      overlap: the next address is tried attempt_delay_ms after the previous \
+ *      attempt started, or right away when an attempt fails; the first connection \
+ *      to complete is kept and the other attempts are closed.
+ * @param err out: why no connection was made - ETIMEDOUT, or the error of the last attempt
+ * @return a connected non blocking socket with TCP_NODELAY, -1 on failure
+ */
+inline int client_connect(const vector<client_addr>& addrs, int timeout_ms, int attempt_delay_ms, int& err) {
+    vector<pollfd> pending;
+    size_t next = 0;
+    int winner = -1;
+    int64_t now = client_now_ms();
+    int64_t deadline = now + max(timeout_ms, 0);
+    int64_t next_start = now;
+    err = addrs.empty() ? EADDRNOTAVAIL : ETIMEDOUT;
+    while (winner < 0) {
+        now = client_now_ms();
+        if (next < addrs.size() && (now >= next_start || pending.empty())) {
+            const client_addr& a = addrs[next++];
+            int fd = socket(a.sa.ss_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                err = errno;
+                continue;
+            }
+            if (connect(fd, reinterpret_cast<const sockaddr*>(&a.sa), a.len) == 0) {
+                winner = fd;
+                break;
+            }
+            if (errno != EINPROGRESS) {
+                // refused outright - the next address goes at once
+                err = errno;
+                close(fd);
+                continue;
+            }
+            pending.push_back(pollfd{fd, POLLOUT, 0});
+            next_start = now + attempt_delay_ms;
+            continue;
+        }
+        if (pending.empty()) break;
+        if (now >= deadline) {
+            err = ETIMEDOUT;
+            break;
+        }
+        int64_t until = next < addrs.size() ? min(deadline, next_start) : deadline;
+        int n = poll(pending.data(), nfds_t(pending.size()), int(max<int64_t>(until - now, 0)));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            err = errno;
+            break;
+        }
+        for (size_t i = 0; i < pending.size() && winner < 0; ) {
+            if (!pending[i].revents) {
+                i++;
+                continue;
+            }
+            int so_err = 0;
+            socklen_t len = sizeof(so_err);
+            getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &so_err, &len);
+            if (so_err == 0 && !(pending[i].revents & (POLLERR|POLLHUP))) {
+                winner = pending[i].fd;
+                pending.erase(pending.begin() + ptrdiff_t(i));
+                break;
+            }
+            err = so_err ? so_err : ECONNREFUSED;
+            close(pending[i].fd);
+            pending.erase(pending.begin() + ptrdiff_t(i));
+            next_start = now;
+        }
+    }
+    for (auto& p : pending) close(p.fd);
+    if (winner >= 0) {
+        int one = 1;
+        setsockopt(winner, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return winner;
+}
+
+/**
+ * @brief One client connection, used by one thread at a time. send() only queues, \
+ *      so requests are pipelined: any number of them leave together and their \
+ *      replies are taken in order with receive(). A request is a frame answered \
+ *      by one frame, except record batches of the sort service, which ride along \
+ *      unanswered (and are answered by many) - outstanding() counts the others. \
+ *      Frames are parsed into blocks of the thread's buffer_pool, held only while \
+ *      bytes are buffered, so an idle connection may move to another thread.
+ */
+class client_conn {
+public:
+    client_conn(int fd, frame_mode framing, uint32_t max_frame)
+        : fd_(fd), framing_(framing), parser_(framing, max_frame) {}
+    client_conn(const client_conn&) = delete;
+    client_conn& operator=(const client_conn&) = delete;
+    ~client_conn() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    /**
+     * @brief Queue a request - written by the next flush() or receive()
+     */
+    void send(frame_op op, string_view payload = {}) {
+        if (framing_ == frame_mode::delimited) {
+            out_.append(op == frame_op::disconnect ? string_view("[buybuy]") : payload);
+            out_ += '\n';
+        } else {
+            frame_append(out_, op, payload);
+        }
+        if (op != frame_op::sort_records) outstanding_++;
+        if (op == frame_op::disconnect) reusable_ = false;
+    }
+
+    /**
+     * @brief Write everything queued - replies arriving meanwhile are buffered
+     * @return false on an error or timeout (error())
+     */
+    bool flush(int timeout_ms) { return pump(client_now_ms() + timeout_ms, false); }
+
+    /**
+     * @brief The next reply, after writing what is queued
+     * @return nullptr on an error or timeout (error()); the frame is valid until the next receive()
+     */
+    const frame* receive(int timeout_ms) {
+        if (!pump(client_now_ms() + timeout_ms, true)) return nullptr;
+        if (cur_.op != frame_op::sort_records && outstanding_) outstanding_--;
+        return &cur_;
+    }
+
+    size_t outstanding() const { return outstanding_; }
+    bool ok() const { return err_ == 0; }
+    int error() const { return err_; }
+    int fd() const { return fd_; }
+
+    /**
+     * @return nothing is owed either way - the connection may serve another session
+     */
+    bool idle() const { return ok() && reusable_ && outstanding_ == 0 && out_.empty() && !parser_.buffered(); }
+
+private:
+    friend class client_pool;
+
+    /**
+     * @brief Write the queued bytes and read replies until (want_frame) a frame is in \
+     *      cur_ or (else) the output is written
+     */
+    bool pump(int64_t deadline, bool want_frame) {
+        if (!ok()) return false;
+        for (;;) {
+            if (want_frame && parser_.next(cur_)) return true;
+            if (parser_.failed()) return fail(EPROTO);
+            while (out_at_ < out_.size()) {
+                ssize_t w = ::send(fd_, out_.data() + out_at_, out_.size() - out_at_, MSG_NOSIGNAL|MSG_DONTWAIT);
+                if (w < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN) break;
+                    return fail(errno);
+                }
+                out_at_ += size_t(w);
+            }
+            if (out_at_ == out_.size()) {
+                out_.clear();
+                out_at_ = 0;
+                if (!want_frame) return true;
+            }
+            // read whatever came - a peer blocked on its replies would not take our requests
+            bool readable = true;
+            while (readable) {
+                size_t space;
+                char* p = parser_.prepare(4096, space);
+                ssize_t r = read(fd_, p, space);
+                if (r > 0) {
+                    parser_.commit(size_t(r));
+                    readable = size_t(r) == space;
+                } else if (r == 0) {
+                    return fail(ECONNRESET);
+                } else if (errno == EAGAIN) {
+                    readable = false;
+                } else if (errno != EINTR) {
+                    return fail(errno);
+                }
+            }
+            if (want_frame && parser_.next(cur_)) return true;
+            int64_t now = client_now_ms();
+            if (now >= deadline) return fail(ETIMEDOUT);
+            pollfd pfd{fd_, short(POLLIN|(out_.empty() ? 0 : POLLOUT)), 0};
+            if (poll(&pfd, 1, int(deadline - now)) < 0 && errno != EINTR) return fail(errno);
+        }
+    }
+
+    bool fail(int err) {
+        if (err_ == 0) err_ = err;
+        errno = err_;
+        return false;
+    }
+
+    int fd_;
+    frame_mode framing_;
+    frame_parser parser_;
+    frame cur_{};
+    string out_;
+    size_t out_at_ = 0;
+    size_t outstanding_ = 0;
+    int err_ = 0;
+    bool reusable_ = true;
+    // pool bookkeeping
+    string endpoint_;
+    int64_t idle_since_ = 0;
+};
+
+/**
+ * @brief Keep-alive connections per endpoint (host and port), thread safe. \
+ *      acquire() hands out a pooled connection that is still alive, or connects \
+ *      a new one through the address cache; release() keeps a connection that \
+ *      owes nothing for the next session and closes the rest.
+ */
+class client_pool {
+public:
+    explicit client_pool(const client_options& opt = client_options()) : opt_(opt), cache_(opt.resolve_ttl_ms) {}
+    client_pool(const client_pool&) = delete;
+    client_pool& operator=(const client_pool&) = delete;
+
+    /**
+     * @param err out: errno of the failed connect, or EHOSTUNREACH when the host did not resolve
+     * @return nullptr when no connection could be made
+     */
+    unique_ptr<client_conn> acquire(const string& host, int port, int* err = nullptr) {
+        string key = host + ' ' + to_string(port);
+        int64_t now = client_now_ms();
+        {
+            lock_guard<mutex> lk(lock_);
+            auto& idle = idle_[key];
+            while (!idle.empty()) {
+                unique_ptr<client_conn> c = move(idle.back());
+                idle.pop_back();
+                if (now - c->idle_since_ < opt_.idle_ttl_ms && alive(*c)) {
+                    reused_.fetch_add(1, memory_order_relaxed);
+                    return c;
+                }
+                expired_.fetch_add(1, memory_order_relaxed);
+            }
+        }
+        vector<client_addr> addrs;
+        int rc = cache_.resolve(host, port, addrs);
+        if (rc != 0) {
+            ERROR("getaddrinfo " << host << ": " << gai_strerror(rc));
+            if (err) *err = EHOSTUNREACH;
+            return nullptr;
+        }
+        int e = 0;
+        int fd = client_connect(addrs, opt_.connect_timeout_ms, opt_.attempt_delay_ms, e);
+        if (fd < 0) {
+            // the addresses may be stale - resolve again next time
+            cache_.invalidate(host, port);
+            if (err) *err = e;
+            return nullptr;
+        }
+        connects_.fetch_add(1, memory_order_relaxed);
+        auto c = make_unique<client_conn>(fd, opt_.framing, opt_.max_frame);
+        c->endpoint_ = move(key);
+        return c;
+    }
+
+    /**
+     * @brief Done with a connection - pooled when it owes nothing and there is room, else closed
+     */
+    void release(unique_ptr<client_conn> c) {
+        if (!c || !c->idle()) return;
+        // the parser may still hold the block of the last reply - it must not leave this thread
+        c->parser_.reset();
+        c->idle_since_ = client_now_ms();
+        lock_guard<mutex> lk(lock_);
+        auto& idle = idle_[c->endpoint_];
+        if (idle.size() < opt_.max_idle) idle.push_back(move(c));
+    }
+
+    /**
+     * @brief Close the pooled connections
+     */
+    void clear() {
+        lock_guard<mutex> lk(lock_);
+        idle_.clear();
+    }
+
+    addr_cache& resolver() { return cache_; }
+    uint64_t connects() const { return connects_.load(memory_order_relaxed); }
+    uint64_t reused() const { return reused_.load(memory_order_relaxed); }
+    uint64_t expired() const { return expired_.load(memory_order_relaxed); }
+
+private:
+    /**
+     * @brief An idle connection is alive while the peer has neither closed it nor sent anything
+     */
+    static bool alive(const client_conn& c) {
+        char b;
+        ssize_t r = recv(c.fd_, &b, 1, MSG_PEEK|MSG_DONTWAIT);
+        return r < 0 && (errno == EAGAIN || errno == EINTR);
+    }
+
+    client_options opt_;
+    addr_cache cache_;
+    mutex lock_;
+    unordered_map<string, vector<unique_ptr<client_conn>>> idle_;
+    atomic_uint64_t connects_{0};
+    atomic_uint64_t reused_{0};
+    atomic_uint64_t expired_{0};
+};
+
+#endif // _NET_CLIENT_HXX_
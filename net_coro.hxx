@@ -0,0 +1,766 @@
+/**
+ * @file net_coro.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief C++20 coroutine sessions on an edge triggered epoll reactor for the
+ *      network demos. A connection handler is straight line code -
+ *      co_await conn.read(), co_await conn.write(bytes), co_await coro_sleep(ms) -
+ *      and suspends only when the socket has nothing for it or no room, so a
+ *      session costs its coroutine frame (from a per reactor pool) and its
+ *      connection slot, never a thread. Work handed to other threads wakes its
+ *      session through the reactor's mailbox (co_await conn.wait_notify()).
+ *      Needs -std=c++20.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_CORO_HXX_
+#define _NET_CORO_HXX_
+
+#if !defined(__cpp_impl_coroutine)
+#error "net_coro.hxx needs C++20 coroutines (-std=c++20)"
+#endif
+
+#include <cerrno>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "net_buffer.hxx"
+#include "net_frame.hxx"
+#include "net_metrics.hxx"
+#include "net_slab.hxx"
+#include "net_timer.hxx"
+
+using namespace std;
+
+/**
+ * @brief Coroutine frames in size classes of 64 bytes, carved from 64 KiB chunks \
+ *      that are kept while the pool lives - a new session never reaches malloc \
+ *      once the pool has seen as many. One pool per thread (local()), i.e. per reactor.
+ */
+class coro_frame_pool {
+public:
+    static constexpr size_t granule = 64;
+    static constexpr size_t classes = 32;           // frames up to 2 KiB, larger ones go to operator new
+    static constexpr size_t chunk_size = 64*1024;
+
+    coro_frame_pool() = default;
+    coro_frame_pool(const coro_frame_pool&) = delete;
+    coro_frame_pool& operator=(const coro_frame_pool&) = delete;
+
+    static coro_frame_pool& local() {
+        thread_local coro_frame_pool pool;
+        return pool;
+    }
+
+    void* allocate(size_t n) {
+        size_t cls = (n + granule - 1)/granule;
+        if (cls > classes) return ::operator new(n);
+        free_node*& head = free_[cls - 1];
+        if (!head) refill(cls);
+        free_node* f = head;
+        head = f->next;
+        return f;
+    }
+
+    void release(void* p, size_t n) {
+        size_t cls = (n + granule - 1)/granule;
+        if (cls > classes) {
+            ::operator delete(p);
+            return;
+        }
+        auto f = static_cast<free_node*>(p);
+        f->next = free_[cls - 1];
+        free_[cls - 1] = f;
+    }
+
+    size_t held_bytes() const { return chunks_.size()*chunk_size; }
+
+private:
+    struct free_node {
+        free_node* next;
+    };
+
+    void refill(size_t cls) {
+        size_t size = cls*granule;
+        chunks_.emplace_back(new char[chunk_size]);
+        char* base = chunks_.back().get();
+        for (size_t off = chunk_size/size*size; off >= size; off -= size) {
+            auto f = reinterpret_cast<free_node*>(base + off - size);
+            f->next = free_[cls - 1];
+            free_[cls - 1] = f;
+        }
+    }
+
+    free_node* free_[classes] = {};
+    vector<unique_ptr<char[]>> chunks_;
+};
+
+/**
+ * Why a connection's reads ended - anything but open is final
+ */
+enum class coro_status : uint8_t {
+    open,
+    eof,            // the client closed its side
+    timeout,        // no complete frame within the read's time limits
+    error,          // read or write failed, error() has the errno
+    malformed,      // the frame parser gave up on the stream
+    overflow,       // the queued output would exceed the output limit
+};
+
+class coro_conn;
+class coro_reactor;
+
+/**
+ * @brief The coroutine type of a connection handler: coro_session handler(coro_conn&, ...). \
+ *      It starts when the reactor has wired it to its connection and the connection \
+ *      closes when it returns.
+ */
+class coro_session {
+public:
+    struct promise_type {
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+            void await_suspend(coroutine_handle<promise_type> h) noexcept;
+            void await_resume() noexcept {}
+        };
+
+        coro_session get_return_object() { return coro_session(handle::from_promise(*this)); }
+        suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+
+        static void* operator new(size_t n) { return coro_frame_pool::local().allocate(n); }
+        static void operator delete(void* p, size_t n) { coro_frame_pool::local().release(p, n); }
+
+        coro_conn* conn = nullptr;
+    };
+    using handle = coroutine_handle<promise_type>;
+
+    coro_session(coro_session&& o) noexcept : h_(exchange(o.h_, {})) {}
+    coro_session& operator=(coro_session&&) = delete;
+    ~coro_session() {
+        if (h_) h_.destroy();
+    }
+
+    handle release() { return exchange(h_, {}); }
+
+private:
+    explicit coro_session(handle h) : h_(h) {}
+
+    handle h_;
+};
+
+/**
+ * A suspended coroutine on the reactor's timer wheel: a sleep, or a connection's read deadline
+ */
+struct coro_timer {
+    explicit coro_timer(coro_conn* c = nullptr) : conn(c) { node.owner = uint64_t(uintptr_t(this)); }
+    coro_timer(const coro_timer&) = delete;
+    coro_timer& operator=(const coro_timer&) = delete;
+
+    timer_node node;
+    coroutine_handle<> waiter;
+    coro_conn* conn;
+};
+
+struct coro_options {
+    frame_mode framing = frame_mode::length_prefixed;
+    uint32_t max_frame = frame_default_max;
+    size_t out_high_water = 64*1024;    // a write suspends while this much output is queued
+    size_t out_limit = 1 << 20;         // a write past it fails the connection (overflow)
+    size_t max_conns = 32768;
+    int max_events = 256;               // events taken from one epoll_wait
+    int tick_ms = 10;                   // resolution of the sleeps and read deadlines
+};
+
+/**
+ * Socket traffic of a reactor since it started
+ */
+struct coro_stats {
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t eagain = 0;                // reads and writes that found the socket not ready
+};
+
+/**
+ * @brief Connection handles posted to a reactor from other threads: post() queues \
+ *      the handle and signals an eventfd the reactor watches, the reactor resumes \
+ *      the session if it waits in wait_notify() (or lets its next wait_notify() \
+ *      go through). Held by shared_ptr - a worker finishing after its session, or \
+ *      the whole reactor, went away posts into the void.
+ */
+class coro_mailbox {
+public:
+    coro_mailbox() : fd_(eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)) {}
+    coro_mailbox(const coro_mailbox&) = delete;
+    coro_mailbox& operator=(const coro_mailbox&) = delete;
+    ~coro_mailbox() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    /**
+     * @brief Thread safe - the eventfd is written only when the queue was empty
+     */
+    void post(uint64_t handle) {
+        {
+            lock_guard<mutex> lk(lock_);
+            if (closed_) return;
+            posted_.push_back(handle);
+            if (posted_.size() > 1) return;
+        }
+        uint64_t one = 1;
+        if (write(fd_, &one, sizeof(one)) < 0) {
+            // EAGAIN: the counter is full, the reactor is woken anyway
+        }
+    }
+
+    /**
+     * @brief The reactor takes what was posted
+     */
+    void take(vector<uint64_t>& out) {
+        uint64_t count;
+        if (read(fd_, &count, sizeof(count)) < 0) {
+            // EAGAIN: taken along with an earlier signal
+        }
+        lock_guard<mutex> lk(lock_);
+        out.swap(posted_);
+    }
+
+    void shut() {
+        lock_guard<mutex> lk(lock_);
+        closed_ = true;
+        posted_.clear();
+    }
+
+    int fd() const { return fd_; }
+
+private:
+    int fd_;
+    mutex lock_;
+    vector<uint64_t> posted_;
+    bool closed_ = false;
+};
+
+/**
+ * @brief A client connection as its session sees it. Frames are views into the \
+ *      receive buffer, valid until the next read; writes are copied into the \
+ *      output ring, which the reactor flushes once per pass for every connection.
+ */
+class coro_conn {
+public:
+    coro_conn(coro_reactor& r, int fd);
+    coro_conn(const coro_conn&) = delete;
+    coro_conn& operator=(const coro_conn&) = delete;
+    ~coro_conn() {
+        if (session_) session_.destroy();
+        close(fd_);
+    }
+
+    struct read_awaiter {
+        coro_conn& c;
+        int idle_ms;
+        int partial_ms;
+
+        bool await_ready() { return c.fill(); }
+        void await_suspend(coroutine_handle<> h) { c.begin_read(h, idle_ms, partial_ms); }
+        const frame* await_resume() { return c.have_ ? &c.cur_ : nullptr; }
+    };
+
+    struct write_awaiter {
+        coro_conn& c;
+        string_view bytes;
+
+        bool await_ready() { return c.queue(bytes); }
+        void await_suspend(coroutine_handle<> h) { c.begin_write(h); }
+        bool await_resume() const { return c.status_ == coro_status::open; }
+    };
+
+    struct notify_awaiter {
+        coro_conn& c;
+
+        bool await_ready() { return exchange(c.notified_, false) || c.status_ != coro_status::open; }
+        void await_suspend(coroutine_handle<> h) {
+            c.wait_ = wait_kind::notify;
+            c.waiter_ = h;
+        }
+        bool await_resume() {
+            c.notified_ = false;
+            return c.status_ == coro_status::open;
+        }
+    };
+
+    /**
+     * @brief The next frame, nullptr once the connection is done (status() tells why)
+     * @param idle_ms a complete frame must arrive within, 0: no limit
+     * @param partial_ms once part of a frame is buffered, the rest must follow within, 0: no limit
+     */
+    read_awaiter read(int idle_ms = 0, int partial_ms = 0) { return read_awaiter{*this, idle_ms, partial_ms}; }
+
+    /**
+     * @brief Queue bytes for the client - suspends only while the output is over the high water mark
+     * @return false once the connection is done
+     */
+    write_awaiter write(string_view bytes) { return write_awaiter{*this, bytes}; }
+
+    /**
+     * @brief Wait until handle() is posted to the reactor's mailbox - at once when it \
+     *      was posted since the last wait. The socket is not read meanwhile.
+     * @return false once the connection is done
+     */
+    notify_awaiter wait_notify() { return notify_awaiter{*this}; }
+
+    coro_status status() const { return status_; }
+    int error() const { return err_; }
+    int fd() const { return fd_; }
+    uint64_t handle() const { return self_; }
+    coro_reactor& reactor() { return r_; }
+
+    /**
+     * @return the timeout hit a partially received frame, not an idle connection
+     */
+    bool partial_timeout() const { return partial_hit_; }
+
+private:
+    friend class coro_reactor;
+    friend class coro_session;
+
+    enum class wait_kind : uint8_t { none, read, write, notify };
+
+    bool fill();
+    bool queue(string_view bytes);
+    void begin_read(coroutine_handle<> h, int idle_ms, int partial_ms);
+    void begin_write(coroutine_handle<> h);
+    void arm_timer();
+    void on_events(uint32_t events);
+    void on_timeout();
+    void on_notify();
+    void flush_now();
+    void update_interest();
+    void stop(coro_status s, int err = 0);
+    void fail(coro_status s, int err = 0);
+    void wake();
+    void finish();
+
+    coro_reactor& r_;
+    int fd_;
+    uint64_t self_ = 0;                 // handle in the reactor's table
+    frame_parser parser_;
+    out_ring out_;
+    frame cur_{};
+    coroutine_handle<> session_;
+    coroutine_handle<> waiter_;
+    coro_timer timer_{this};
+    uint64_t idle_deadline_ = 0;        // ticks, 0: none
+    uint64_t partial_deadline_ = 0;
+    int partial_ms_ = 0;
+    uint32_t events_ = 0;               // registered interest
+    int err_ = 0;
+    coro_status status_ = coro_status::open;
+    wait_kind wait_ = wait_kind::none;
+    bool readable_ = false;             // edge seen, no EAGAIN since
+    bool have_ = false;                 // cur_ holds the frame of the last read
+    bool dirty_ = false;                // on the flush list of this pass
+    bool done_ = false;                 // the session returned, closed at the end of the pass
+    bool partial_hit_ = false;
+    bool notified_ = false;             // posted while not waiting for it
+};
+
+/**
+ * @brief One epoll instance with its sessions, run by one thread through poll(). \
+ *      Sessions are resumed right from the event dispatch; the output of a pass is \
+ *      flushed and the sessions that returned are closed at the end of the pass. \
+ *      The caller's own descriptors (a listener, a wake eventfd) are watched under \
+ *      user_tag()s and handed back to it.
+ */
+class coro_reactor {
+public:
+    using conn_table = slab_table<coro_conn>;
+    static constexpr unsigned user_tags = 16;
+
+    static constexpr uint64_t user_tag(unsigned k) { return conn_table::nil - k; }
+
+    explicit coro_reactor(const coro_options& opt)
+        : opt_(opt), epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+          tick_ns_(uint64_t(max(1, opt.tick_ms))*1000000), tick_(metrics_now_ns()/tick_ns_),
+          wheel_(tick_), mailbox_(make_shared<coro_mailbox>()), events_(size_t(max(1, opt.max_events))),
+          conns_(opt.max_conns) {
+        current_ref() = this;
+        if (epoll_fd_ >= 0 && (mailbox_->fd() < 0 || !watch(mailbox_->fd(), EPOLLIN, mailbox_tag))) {
+            close(epoll_fd_);
+            epoll_fd_ = -1;
+        }
+    }
+    coro_reactor(const coro_reactor&) = delete;
+    coro_reactor& operator=(const coro_reactor&) = delete;
+    ~coro_reactor() {
+        if (current_ref() == this) current_ref() = nullptr;
+        mailbox_->shut();
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+    }
+
+    bool ok() const { return epoll_fd_ >= 0; }
+
+    /**
+     * @return the reactor of the calling thread
+     */
+    static coro_reactor* current() { return current_ref(); }
+
+    /**
+     * @brief Where other threads post connection handles to wake their sessions
+     */
+    const shared_ptr<coro_mailbox>& mailbox() const { return mailbox_; }
+
+    /**
+     * @brief Watch (or change the interest in) one of the caller's descriptors
+     */
+    bool watch(int fd, uint32_t events, uint64_t tag) {
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.u64 = tag;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0) return true;
+        return errno == ENOENT && epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    /**
+     * @brief Take a connected non blocking socket and start handler(conn) on it
+     * @return false when the connection could not be taken - the socket is closed either way
+     */
+    template<typename F>
+    bool spawn(int fd, F&& handler) {
+        uint64_t h = conns_.insert(*this, fd);
+        if (h == conn_table::nil) {
+            close(fd);
+            return false;
+        }
+        coro_conn& c = *conns_.get(h);
+        c.self_ = h;
+        c.events_ = EPOLLIN|EPOLLRDHUP|EPOLLET;
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = c.events_;
+        ev.data.u64 = h;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            conns_.erase(h);
+            return false;
+        }
+        coro_session::handle session = handler(c).release();
+        session.promise().conn = &c;
+        c.session_ = session;
+        session.resume();
+        return true;
+    }
+
+    struct sleep_awaiter {
+        coro_reactor& r;
+        uint64_t ticks;
+        coro_timer timer{};
+
+        bool await_ready() const { return false; }
+        void await_suspend(coroutine_handle<> h) {
+            timer.waiter = h;
+            r.wheel_.schedule(timer.node, r.tick_ + ticks);
+        }
+        void await_resume() const {}
+    };
+
+    /**
+     * @brief Suspend the calling session for ms (rounded up to ticks), 0: until the next tick
+     */
+    sleep_awaiter sleep(int ms) { return sleep_awaiter{*this, ticks(ms)}; }
+
+    /**
+     * @brief One pass: wait for events - no longer than timeout_ms (-1: no limit) or \
+     *      the next timer - resume the sessions they concern, flush the output and \
+     *      close the connections whose sessions returned. on_tag(tag, events) gets \
+     *      the events of the caller's descriptors.
+     * @return the events of the pass, -1 when epoll_wait failed (errno)
+     */
+    template<typename F>
+    int poll(int timeout_ms, F&& on_tag) {
+        int64_t due = wheel_.next_due();
+        if (due >= 0) {
+            uint64_t due_ns = (wheel_.now() + uint64_t(due))*tick_ns_;
+            uint64_t now = metrics_now_ns();
+            int ms = due_ns > now ? int((due_ns - now + 999999)/1000000) : 0;
+            timeout_ms = timeout_ms < 0 ? ms : min(timeout_ms, ms);
+        }
+        int n = epoll_wait(epoll_fd_, events_.data(), int(events_.size()), timeout_ms);
+        if (n < 0) return errno == EINTR ? 0 : -1;
+        woke_ns_ = metrics_now_ns();
+        tick_ = woke_ns_/tick_ns_;
+        for (int i = 0; i < n; i++) {
+            uint64_t tag = events_[i].data.u64;
+            if (tag == mailbox_tag) {
+                mailbox_->take(posted_);
+                for (uint64_t h : posted_) {
+                    coro_conn* c = conns_.get(h);
+                    if (c && !c->done_) c->on_notify();
+                }
+                posted_.clear();
+                continue;
+            }
+            if (tag > mailbox_tag) {
+                on_tag(tag, events_[i].events);
+                continue;
+            }
+            coro_conn* c = conns_.get(tag);
+            if (c && !c->done_) c->on_events(events_[i].events);
+        }
+        tick_ = metrics_now_ns()/tick_ns_;
+        wheel_.advance(tick_, [this](timer_node& node) {
+            auto t = reinterpret_cast<coro_timer*>(uintptr_t(node.owner));
+            if (t->conn) {
+                t->conn->on_timeout();
+            } else {
+                t->waiter.resume();
+            }
+        });
+        // a flush may fail a connection and resume its session, which may queue more
+        while (!dirty_.empty()) {
+            flushing_.swap(dirty_);
+            for (uint64_t h : flushing_) {
+                coro_conn* c = conns_.get(h);
+                if (!c) continue;
+                c->dirty_ = false;
+                if (!c->out_.empty()) c->flush_now();
+            }
+            flushing_.clear();
+        }
+        for (uint64_t h : done_) conns_.erase(h);
+        done_.clear();
+        return n;
+    }
+
+    size_t size() const { return conns_.size(); }
+    uint64_t tick() const { return tick_; }
+    uint64_t woke_ns() const { return woke_ns_; }
+    const coro_stats& stats() const { return stats_; }
+    const coro_options& options() const { return opt_; }
+
+    uint64_t ticks(int ms) const {
+        uint64_t tick_ms = tick_ns_/1000000;
+        return ms <= 0 ? 0 : (uint64_t(ms) + tick_ms - 1)/tick_ms;
+    }
+
+private:
+    friend class coro_conn;
+
+    static constexpr uint64_t mailbox_tag = conn_table::nil - user_tags;    // below the user tags
+
+    static coro_reactor*& current_ref() {
+        thread_local coro_reactor* r = nullptr;
+        return r;
+    }
+
+    coro_options opt_;
+    int epoll_fd_;
+    uint64_t tick_ns_;
+    uint64_t tick_;
+    uint64_t woke_ns_ = 0;
+    timer_wheel wheel_;
+    coro_stats stats_;
+    shared_ptr<coro_mailbox> mailbox_;
+    vector<epoll_event> events_;
+    vector<uint64_t> dirty_, flushing_, done_, posted_;
+    conn_table conns_;                  // last - the sessions go before the wheel their timers are on
+};
+
+/**
+ * @brief co_await coro_sleep(ms) - on the calling thread's reactor
+ */
+inline coro_reactor::sleep_awaiter coro_sleep(int ms) {
+    return coro_reactor::current()->sleep(ms);
+}
+
+inline void coro_session::promise_type::final_awaiter::await_suspend(coroutine_handle<promise_type> h) noexcept {
+    if (h.promise().conn) h.promise().conn->finish();
+}
+
+inline coro_conn::coro_conn(coro_reactor& r, int fd)
+    : r_(r), fd_(fd), parser_(r.opt_.framing, r.opt_.max_frame), out_(r.opt_.out_limit) {}
+
+/**
+ * @return a frame is in cur_, or the connection is done - false: wait for the socket
+ */
+inline bool coro_conn::fill() {
+    have_ = false;
+    while (status_ == coro_status::open) {
+        if (parser_.next(cur_)) {
+            have_ = true;
+            return true;
+        }
+        if (parser_.failed()) {
+            stop(coro_status::malformed);
+            break;
+        }
+        if (!readable_) return false;
+        // read straight into the parser - frames are views into it
+        size_t space;
+        char* p = parser_.prepare(4096, space);
+        ssize_t r = ::read(fd_, p, space);
+        if (r > 0) {
+            r_.stats_.bytes_in += uint64_t(r);
+            parser_.commit(size_t(r));
+        } else if (r == 0) {
+            stop(coro_status::eof);
+        } else if (errno == EAGAIN) {
+            r_.stats_.eagain++;
+            readable_ = false;
+            return false;
+        } else if (errno != EINTR) {
+            stop(coro_status::error, errno);
+        }
+    }
+    return true;
+}
+
+/**
+ * @return the write is complete - false: wait until the output drains below the high water mark
+ */
+inline bool coro_conn::queue(string_view bytes) {
+    if (status_ != coro_status::open) return true;
+    if (!out_.append(bytes.data(), bytes.size())) {
+        stop(coro_status::overflow);
+        return true;
+    }
+    if (!dirty_) {
+        dirty_ = true;
+        r_.dirty_.push_back(self_);
+    }
+    if (out_.size() < r_.opt_.out_high_water) return true;
+    flush_now();
+    return status_ != coro_status::open || out_.size() < r_.opt_.out_high_water;
+}
+
+inline void coro_conn::begin_read(coroutine_handle<> h, int idle_ms, int partial_ms) {
+    wait_ = wait_kind::read;
+    waiter_ = h;
+    idle_deadline_ = idle_ms > 0 ? r_.tick_ + r_.ticks(idle_ms) : 0;
+    partial_deadline_ = 0;
+    partial_ms_ = partial_ms;
+    arm_timer();
+}
+
+inline void coro_conn::begin_write(coroutine_handle<> h) {
+    wait_ = wait_kind::write;
+    waiter_ = h;
+}
+
+/**
+ * @brief The read deadline: the idle one, or the partial frame one when that is earlier
+ */
+inline void coro_conn::arm_timer() {
+    if (partial_ms_ > 0 && !partial_deadline_ && parser_.buffered()) {
+        partial_deadline_ = r_.tick_ + r_.ticks(partial_ms_);
+    }
+    uint64_t deadline = idle_deadline_ ? idle_deadline_ : UINT64_MAX;
+    if (partial_deadline_) deadline = min(deadline, partial_deadline_);
+    if (deadline == UINT64_MAX) {
+        r_.wheel_.cancel(timer_.node);
+    } else {
+        r_.wheel_.schedule(timer_.node, deadline);
+    }
+}
+
+inline void coro_conn::on_events(uint32_t events) {
+    if (events & (EPOLLOUT|EPOLLERR|EPOLLHUP) && !out_.empty()) flush_now();
+    if (events & (EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR)) {
+        readable_ = true;
+        if (wait_ != wait_kind::read) return;
+        if (fill()) {
+            wake();
+        } else {
+            arm_timer();
+        }
+    }
+}
+
+inline void coro_conn::on_timeout() {
+    if (wait_ != wait_kind::read) return;
+    partial_hit_ = partial_deadline_ && partial_deadline_ <= r_.wheel_.now();
+    fail(coro_status::timeout);
+}
+
+inline void coro_conn::on_notify() {
+    if (wait_ == wait_kind::notify) {
+        wake();
+    } else {
+        notified_ = true;
+    }
+}
+
+/**
+ * @brief Send what the socket takes - a waiting writer goes on once below the high water mark
+ */
+inline void coro_conn::flush_now() {
+    flush_result fr = out_.flush(fd_, false, &r_.stats_.bytes_out);
+    if (fr == flush_result::error) {
+        out_.reset();
+        fail(coro_status::error, errno);
+        return;
+    }
+    if (fr == flush_result::blocked) r_.stats_.eagain++;
+    update_interest();
+    if (wait_ == wait_kind::write && out_.size() < r_.opt_.out_high_water) wake();
+}
+
+/**
+ * @brief Ask for EPOLLOUT while output is queued - reads stay edge triggered all along
+ */
+inline void coro_conn::update_interest() {
+    uint32_t want = EPOLLIN|EPOLLRDHUP|EPOLLET;
+    if (!out_.empty()) want |= EPOLLOUT;
+    if (want == events_) return;
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = want;
+    ev.data.u64 = self_;
+    epoll_ctl(r_.epoll_fd_, EPOLL_CTL_MOD, fd_, &ev);
+    events_ = want;
+}
+
+/**
+ * @brief The connection is done - the first reason sticks
+ */
+inline void coro_conn::stop(coro_status s, int err) {
+    if (status_ == coro_status::open) {
+        status_ = s;
+        err_ = err;
+    }
+}
+
+/**
+ * @brief stop() from outside the session's awaits - a waiting session goes on
+ */
+inline void coro_conn::fail(coro_status s, int err) {
+    stop(s, err);
+    if (wait_ != wait_kind::none) wake();
+}
+
+inline void coro_conn::wake() {
+    r_.wheel_.cancel(timer_.node);
+    wait_ = wait_kind::none;
+    exchange(waiter_, {}).resume();
+}
+
+inline void coro_conn::finish() {
+    r_.wheel_.cancel(timer_.node);
+    done_ = true;
+    r_.done_.push_back(self_);
+}
+
+#endif // _NET_CORO_HXX_
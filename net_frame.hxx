@@ -0,0 +1,280 @@
+/**
+ * @file net_frame.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Message framing for the network demos: length prefixed binary frames
+ *      (4 byte payload length in network order, 1 byte opcode, payload) or
+ *      delimited text lines. The per connection frame_parser is incremental -
+ *      a read may carry part of a frame or many frames - and hands out views
+ *      into the receive buffer instead of copies. The receive buffer is a
+ *      block of the thread's buffer_pool, a handler keeps a frame's bytes with
+ *      frame::keep().
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_FRAME_HXX_
+#define _NET_FRAME_HXX_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <arpa/inet.h>
+#include "net_buffer.hxx"
+
+using namespace std;
+
+/**
+ * Frame opcodes - control messages are told apart by opcode, never by content
+ */
+enum class frame_op : uint8_t {
+    data = 0,           // application payload
+    ack = 1,            // acknowledgement of a data (or disconnect) frame
+    disconnect = 2,     // the client is done - acknowledged, then the connection closes
+    sort_records = 3,   // sort service: a batch of records to sort (client) or sorted (server)
+    sort_end = 4,       // sort service: the client's input is complete / the server's output is, with the count
+};
+
+enum class frame_mode : uint8_t {
+    length_prefixed,    // binary frames: length, opcode, payload
+    delimited,          // text lines, a line "[buybuy]" (any case) is the disconnect
+};
+
+constexpr size_t frame_header_size = 5;
+constexpr uint32_t frame_default_max = 1u << 24;
+
+/**
+ * One parsed frame, the payload points into the parser's (or the caller's) buffer
+ * and stays valid only until the parser is handed more data.
+ */
+struct frame {
+    frame_op op;
+    string_view payload;
+    buf_block* block = nullptr;     // the parser's block holding the payload, none for a foreign buffer
+
+    /**
+     * @brief The payload beyond the callback - shares the parser's block, copies only foreign bytes
+     */
+    buf_slice keep() const {
+        return block ? buf_slice(block, payload.data(), payload.size()) : buf_slice::copy_of(payload);
+    }
+};
+
+/**
+ * @brief Write a frame header: payload length in network order and the opcode
+ * @param out frame_header_size bytes
+ */
+inline void frame_put_header(char* out, frame_op op, uint32_t payload_len) {
+    uint32_t be_len = htonl(payload_len);
+    memcpy(out, &be_len, sizeof(be_len));
+    out[4] = char(op);
+}
+
+/**
+ * @brief Append one encoded frame to an output buffer
+ */
+inline void frame_append(string& out, frame_op op, string_view payload = {}) {
+    size_t at = out.size();
+    out.resize(at + frame_header_size + payload.size());
+    frame_put_header(&out[at], op, uint32_t(payload.size()));
+    if (!payload.empty()) memcpy(&out[at + frame_header_size], payload.data(), payload.size());
+}
+
+/**
+ * @brief Incremental frame parser of one connection. \
+ *      Bytes come in either by reading straight into the parser (prepare() / \
+ *      commit() / drain()) or from a buffer owned by someone else (feed()), \
+ *      where complete frames are viewed in place and only a trailing partial \
+ *      frame is copied. The buffer is a pool block held only while bytes are \
+ *      buffered, so idle connections cost nothing; a block still referenced by \
+ *      kept frames is left to them and the parser moves to a fresh one. \
+ *      The frame callback returns false to stop parsing (e.g. on disconnect); \
+ *      it must not destroy the parser.
+ */
+class frame_parser {
+public:
+    explicit frame_parser(frame_mode mode = frame_mode::length_prefixed,
+                          uint32_t max_frame = frame_default_max, char delim = '\n')
+        : mode_(mode), delim_(delim), max_frame_(max_frame) {}
+    frame_parser(frame_parser&& o) noexcept { *this = move(o); }
+    frame_parser& operator=(frame_parser&& o) noexcept {
+        if (this != &o) {
+            reset();
+            swap(blk_, o.blk_);
+            begin_ = o.begin_;
+            end_ = o.end_;
+            scanned_ = o.scanned_;
+            mode_ = o.mode_;
+            delim_ = o.delim_;
+            max_frame_ = o.max_frame_;
+            failed_ = o.failed_;
+            o.begin_ = o.end_ = o.scanned_ = 0;
+        }
+        return *this;
+    }
+    ~frame_parser() { buf_unref(blk_); }
+
+    /**
+     * @brief Space for the next read, at least min_space bytes - never zeroed
+     * @param space out: usable bytes at the returned pointer
+     */
+    char* prepare(size_t min_space, size_t& space) {
+        if (!blk_ || blk_->cap - end_ < min_space) {
+            size_t pending = end_ - begin_;
+            if (blk_ && blk_->refs == 1 && blk_->cap - pending >= min_space) {
+                // move the partial frame to the front
+                memmove(blk_->data(), blk_->data() + begin_, pending);
+            } else {
+                // grow - or leave the block to the frames kept from it
+                buf_block* blk = buffer_pool::local().acquire(max(pending + min_space, blk_ ? blk_->cap : 0));
+                if (pending) memcpy(blk->data(), blk_->data() + begin_, pending);
+                buf_unref(blk_);
+                blk_ = blk;
+            }
+            scanned_ = scanned_ > begin_ ? scanned_ - begin_ : 0;
+            end_ = pending;
+            begin_ = 0;
+        }
+        space = blk_->cap - end_;
+        return blk_->data() + end_;
+    }
+
+    void commit(size_t n) { end_ += n; }
+
+    /**
+     * @brief Hand every complete buffered frame to on_frame
+     * @return false when on_frame stopped the parse or the stream is malformed (failed())
+     */
+    template<typename F>
+    bool drain(F&& on_frame) {
+        if (!blk_) return true;
+        bool go = true;
+        begin_ += parse(blk_->data() + begin_, end_ - begin_, on_frame, go);
+        if (!go || failed_) return false;
+        if (begin_ == end_) {
+            // nothing buffered - the block goes back to the pool
+            buf_unref(blk_);
+            blk_ = nullptr;
+            begin_ = end_ = scanned_ = 0;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Take the next complete buffered frame - for a consumer that goes one frame at a time
+     * @return false when no complete frame is buffered, or the stream is malformed (failed())
+     */
+    bool next(frame& out) {
+        bool got = false;
+        drain([&](const frame& f) {
+            out = f;
+            got = true;
+            return false;
+        });
+        return got;
+    }
+
+    /**
+     * @brief Parse bytes that arrived in a foreign buffer
+     * @see drain()
+     */
+    template<typename F>
+    bool feed(const char* data, size_t n, F&& on_frame) {
+        if (begin_ == end_) {
+            bool go = true;
+            size_t used = parse(data, n, on_frame, go);
+            if (!go || failed_) return false;
+            data += used;
+            n -= used;
+            if (n == 0) return true;
+        }
+        size_t space;
+        memcpy(prepare(n, space), data, n);
+        commit(n);
+        return drain(on_frame);
+    }
+
+    bool failed() const { return failed_; }
+    size_t buffered() const { return end_ - begin_; }
+
+    /**
+     * @brief Forget buffered bytes and errors - the connection slot is reused
+     */
+    void reset() {
+        buf_unref(blk_);
+        blk_ = nullptr;
+        begin_ = end_ = scanned_ = 0;
+        failed_ = false;
+    }
+
+private:
+    /**
+     * @return bytes consumed - complete frames only
+     */
+    template<typename F>
+    size_t parse(const char* p, size_t n, F& on_frame, bool& go) {
+        size_t off = 0;
+        bool own = blk_ && p == blk_->data() + begin_;
+        buf_block* block = own ? blk_ : nullptr;
+        if (mode_ == frame_mode::length_prefixed) {
+            while (n - off >= frame_header_size) {
+                uint32_t be_len;
+                memcpy(&be_len, p + off, sizeof(be_len));
+                uint32_t len = ntohl(be_len);
+                if (len > max_frame_) {
+                    failed_ = true;
+                    return off;
+                }
+                if (n - off - frame_header_size < len) break;
+                frame f{frame_op(uint8_t(p[off + 4])), string_view(p + off + frame_header_size, len), block};
+                off += frame_header_size + len;
+                if (!(go = on_frame(f))) return off;
+            }
+            return off;
+        }
+        // delimited: lines already scanned for a delimiter are not scanned again
+        size_t from = own ? max(scanned_, begin_) - begin_ : 0;
+        while (off < n) {
+            auto pdelim = static_cast<const char*>(memchr(p + from, delim_, n - from));
+            if (!pdelim) {
+                if (n - off > max_frame_) failed_ = true;
+                if (own) scanned_ = begin_ + n;
+                return off;
+            }
+            size_t end = size_t(pdelim - p);
+            size_t len = end - off;
+            if (len > 0 && p[end - 1] == '\r') len--;
+            string_view line(p + off, len);
+            frame f{is_disconnect_line(line) ? frame_op::disconnect : frame_op::data, line, block};
+            off = from = end + 1;
+            if (!(go = on_frame(f))) return off;
+        }
+        return off;
+    }
+
+    /**
+     * text clients keep the old disconnect word
+     */
+    static bool is_disconnect_line(string_view line) {
+        constexpr string_view word = "[buybuy]";
+        if (line.size() != word.size()) return false;
+        for (size_t i = 0; i < word.size(); i++) {
+            if ((line[i] | 0x20) != (word[i] | 0x20)) return false;
+        }
+        return true;
+    }
+
+    buf_block* blk_ = nullptr;
+    size_t begin_ = 0, end_ = 0;
+    size_t scanned_ = 0;            // delimited mode: buffer offset searched up to
+    frame_mode mode_;
+    char delim_;
+    uint32_t max_frame_;
+    bool failed_ = false;
+};
+
+#endif // _NET_FRAME_HXX_
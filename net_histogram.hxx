@@ -0,0 +1,125 @@
+/**
+ * @file net_histogram.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Log-linear histogram in the manner of HdrHistogram, for latencies and
+ *      sizes of the network demos. Values are bucketed by power of two and every
+ *      power is split into linear sub-buckets, so the relative error stays under
+ *      1/64 over the whole 64 bit range with a fixed set of buckets.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_HISTOGRAM_HXX_
+#define _NET_HISTOGRAM_HXX_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+/**
+ * @brief One thread records, any thread may read or merge: the counts are \
+ *      relaxed atomics written with plain load/store, no locked instructions.
+ */
+class hdr_histogram {
+public:
+    static constexpr int sub_bits = 7;
+    static constexpr uint64_t sub_count = uint64_t(1) << sub_bits;
+    static constexpr uint64_t half_count = sub_count/2;
+    static constexpr size_t bucket_count = (64 - sub_bits + 2)*half_count;
+
+    hdr_histogram() : counts_(new atomic_uint64_t[bucket_count]()) {}
+    hdr_histogram(const hdr_histogram&) = delete;
+    hdr_histogram& operator=(const hdr_histogram&) = delete;
+
+    /**
+     * @brief Single writer only
+     */
+    void record(uint64_t value, uint64_t n = 1) {
+        bump(counts_[index(value)], n);
+        bump(total_, n);
+        bump(sum_, value*n);
+        if (value > max_.load(memory_order_relaxed)) max_.store(value, memory_order_relaxed);
+        if (value < min_.load(memory_order_relaxed)) min_.store(value, memory_order_relaxed);
+    }
+
+    /**
+     * @brief Add another histogram's counts - the other one may still be recording
+     */
+    void merge(const hdr_histogram& o) {
+        for (size_t i = 0; i < bucket_count; i++) {
+            uint64_t n = o.counts_[i].load(memory_order_relaxed);
+            if (n) counts_[i].fetch_add(n, memory_order_relaxed);
+        }
+        total_.fetch_add(o.count(), memory_order_relaxed);
+        sum_.fetch_add(o.sum(), memory_order_relaxed);
+        if (o.max() > max()) max_.store(o.max(), memory_order_relaxed);
+        if (o.count() && o.min() < min()) min_.store(o.min(), memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total_.load(memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(memory_order_relaxed); }
+    uint64_t max() const { return max_.load(memory_order_relaxed); }
+    uint64_t min() const { return count() ? min_.load(memory_order_relaxed) : 0; }
+    double mean() const { return count() ? double(sum())/double(count()) : 0.0; }
+
+    /**
+     * @brief The value at a percentile (0..100) - the highest value of its bucket, never above max()
+     */
+    uint64_t value_at(double percentile) const {
+        uint64_t total = count();
+        if (total == 0) return 0;
+        auto rank = uint64_t(percentile/100.0*double(total) + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > total) rank = total;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            seen += counts_[i].load(memory_order_relaxed);
+            if (seen >= rank) return highest(i) < max() ? highest(i) : max();
+        }
+        return max();
+    }
+
+    /**
+     * @brief Visit the non empty buckets in value order: f(lowest, highest, count)
+     */
+    template<typename F>
+    void for_each_bucket(F&& f) const {
+        for (size_t i = 0; i < bucket_count; i++) {
+            uint64_t n = counts_[i].load(memory_order_relaxed);
+            if (n) f(lowest(i), highest(i), n);
+        }
+    }
+
+    static size_t index(uint64_t value) {
+        if (value < sub_count) return size_t(value);
+        int e = 63 - __builtin_clzll(value) - sub_bits + 1;
+        return size_t(e)*half_count + size_t(value >> e);
+    }
+    static uint64_t lowest(size_t idx) {
+        if (idx < sub_count) return idx;
+        size_t e = idx/half_count - 1;
+        return uint64_t(idx - e*half_count) << e;
+    }
+    static uint64_t highest(size_t idx) {
+        if (idx < sub_count) return idx;
+        size_t e = idx/half_count - 1;
+        return ((uint64_t(idx - e*half_count) + 1) << e) - 1;
+    }
+
+private:
+    static void bump(atomic_uint64_t& a, uint64_t n) {
+        a.store(a.load(memory_order_relaxed) + n, memory_order_relaxed);
+    }
+
+    unique_ptr<atomic_uint64_t[]> counts_;
+    atomic_uint64_t total_{0};
+    atomic_uint64_t sum_{0};
+    atomic_uint64_t max_{0};
+    atomic_uint64_t min_{UINT64_MAX};
+};
+
+#endif // _NET_HISTOGRAM_HXX_
@@ -0,0 +1,583 @@
+/**
+ * @file net_load.cxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Load generator for the network6 server. Opens thousands of connections
+ *      over a few epoll threads, sends data frames of a given size with a given
+ *      pipelining depth and measures the latency of every request up to its ack
+ *      in an HDR histogram.
+ *
+ *      closed loop (--rate=0): every connection keeps --depth requests in flight.
+ *      open loop (--rate=R): requests are scheduled at R per second no matter how
+ *      the server keeps up; the latency of a request counts from its scheduled
+ *      time, so a stalled server is charged for the requests it held up
+ *      (no coordinated omission).
+ *      sort (--sort=N): a request is N random 16 byte records for the sort service
+ *      (network6 --service=sort), complete when the last sorted batch and the count
+ *      are back; the order and the count are checked, and the time to the first
+ *      sorted batch is measured too.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ * usage: net_load [--host=::1] [--port=5000] [--conns=1000] [--threads=N] [--size=64] [--depth=1]
+ *                 [--rate=0] [--duration=10] [--warmup=1] [--framing=length|line] [--tag=label]
+ *                 [--csv=results.csv] [--json=results.json] [--sort=records]
+ *
+ *      ./network6 --clients=0 &
+ *      ./net_load --conns=2000 --rate=200000 --duration=30 --json=load.json
+ *      ./network6 --clients=0 --service=sort &      (built with -std=c++20)
+ *      ./net_load --conns=64 --sort=100000 --duration=30
+ */
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include "net_frame.hxx"
+#include "net_buffer.hxx"
+#include "net_log.hxx"
+#include "net_histogram.hxx"
+#include "net_sort.hxx"
+
+using namespace std;
+
+void log_error(string prefix) {
+    ERROR(prefix << ": " << strerror(errno));
+}
+
+/**
+ * Load configuration
+ */
+struct load_config {
+    string host = "::1";
+    int port = 5000;
+    int conns = 1000;
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    size_t size = 64;               // payload bytes of a request
+    int depth = 1;                  // requests in flight per connection
+    double rate = 0;                // requests per second over all connections, 0: closed loop
+    double duration = 10;           // seconds measured
+    double warmup = 1;              // seconds run before measuring
+    frame_mode framing = frame_mode::length_prefixed;
+    size_t sort = 0;                // records of a sort request, 0: data requests
+    string tag;
+    string csv_path;
+    string json_path;
+};
+
+inline int64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * One client connection: the start times of its requests in order - the ones
+ * not yet written are the last `unsent` entries
+ */
+struct load_conn {
+    int fd = -1;
+    bool connected = false;
+    frame_parser parser;
+    out_ring out;                   // room for depth requests, see load_thread()
+    deque<int64_t> started;
+    size_t unsent = 0;
+    // sort requests: the reply of the oldest one so far
+    size_t sorted = 0;
+    uint64_t last_key = 0;
+    bool in_order = true;
+
+    size_t inflight() const { return started.size() - unsent; }
+};
+
+/**
+ * Results of one load thread - written by it, read by main when it is done
+ * (the counters also while it runs, for progress)
+ */
+struct load_stats {
+    hdr_histogram latency;          // ns
+    hdr_histogram first_batch;      // sort requests: ns to the first sorted batch
+    atomic_uint64_t completed{0};   // acks inside the measured window
+    atomic_uint64_t acked{0};       // all acks
+    uint64_t sent = 0;
+    uint64_t bytes_out = 0;
+    uint64_t bytes_in = 0;
+    uint64_t errors = 0;
+    uint64_t connect_failures = 0;
+    uint64_t backlog = 0;           // scheduled requests never sent (open loop)
+    uint64_t unanswered = 0;        // sent requests without an ack at the end
+    uint64_t wrong = 0;             // sort replies out of order or with a wrong count
+};
+
+/**
+ * @brief Resolve the server address once - every connection dials the same one
+ */
+bool load_resolve(const load_config& cfg, sockaddr_storage& addr, socklen_t& addr_len) {
+    addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int rc = getaddrinfo(cfg.host.c_str(), to_string(cfg.port).c_str(), &hints, &res);
+    if (rc != 0) {
+        ERROR("getaddrinfo " << cfg.host << ": " << gai_strerror(rc));
+        return false;
+    }
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+/**
+ * @brief One load thread: its share of the connections on one epoll instance, \
+ *      a timerfd paces the open loop schedule.
+ */
+void load_thread(const load_config& cfg, const sockaddr_storage& addr, socklen_t addr_len, int nconns,
+                 int64_t t_begin, int64_t t_measure, int64_t t_end, load_stats& stats) {
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (epfd < 0 || tfd < 0) {
+        log_error("epoll_create1/timerfd_create failed");
+        return;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = UINT64_MAX;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+
+    // the request bytes are the same every time
+    string request;
+    if (cfg.sort) {
+        // random keys, the values number the records
+        vector<sort_record> records(cfg.sort);
+        uint64_t x = uint64_t(now_ns()) | 1;
+        for (size_t i = 0; i < records.size(); i++) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            records[i] = {x, i};
+        }
+        for (size_t at = 0; at < records.size(); at += 4096) {
+            size_t n = min<size_t>(4096, records.size() - at);
+            frame_append(request, frame_op::sort_records,
+                         string_view(reinterpret_cast<const char*>(&records[at]), n*sizeof(sort_record)));
+        }
+        frame_append(request, frame_op::sort_end);
+    } else if (cfg.framing == frame_mode::delimited) {
+        request.assign(cfg.size, 'x');
+        request += '\n';
+    } else {
+        frame_append(request, frame_op::data, string(cfg.size, 'x'));
+    }
+
+    vector<load_conn> conns(size_t(max(nconns, 0)));
+    for (auto& c : conns) {
+        c.parser = frame_parser(cfg.framing);
+        // at most depth requests are queued - a big sort request must not hit a fixed limit
+        c.out = out_ring(request.size()*size_t(cfg.depth));
+        c.fd = socket(addr.ss_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+        if (c.fd < 0) {
+            log_error("socket failed");
+            stats.connect_failures++;
+            continue;
+        }
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(c.fd, reinterpret_cast<const sockaddr*>(&addr), addr_len) < 0 && errno != EINPROGRESS) {
+            log_error("connect failed");
+            close(c.fd);
+            c.fd = -1;
+            stats.connect_failures++;
+            continue;
+        }
+        ev.events = EPOLLIN|EPOLLOUT|EPOLLET;
+        ev.data.u64 = uint64_t(&c - conns.data());
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+    }
+
+    auto drop = [&](load_conn& c) {
+        stats.errors++;
+        stats.backlog += c.unsent;
+        stats.unanswered += c.inflight();
+        close(c.fd);
+        c.fd = -1;
+        c.started.clear();
+        c.unsent = 0;
+    };
+    // write what the depth allows, then whatever the socket takes
+    auto pump = [&](load_conn& c) {
+        if (c.fd < 0 || !c.connected) return;
+        while (c.unsent > 0 && c.inflight() < size_t(cfg.depth)) {
+            if (!c.out.append(request.data(), request.size())) {
+                ERROR("a request does not fit the output ring - dropping the connection");
+                drop(c);
+                return;
+            }
+            c.unsent--;
+            stats.sent++;
+            stats.bytes_out += request.size();
+        }
+        if (c.out.flush(c.fd) == flush_result::error) drop(c);
+    };
+
+    bool open_loop = cfg.rate > 0;
+    size_t live = 0;
+    for (auto& c : conns) live += c.fd >= 0;
+    // open loop: this thread's share of the rate, handed round robin to the connections
+    double interval = open_loop && live ? 1e9*double(live)/(cfg.rate*double(cfg.conns)) : 0;
+    double next_due = double(t_begin);
+    size_t rr = 0;
+    auto schedule = [&](int64_t now) {
+        if (interval <= 0) return;
+        while (next_due <= double(now) && next_due < double(t_end)) {
+            for (size_t tries = 0; tries < conns.size(); tries++) {
+                load_conn& c = conns[rr++ % conns.size()];
+                if (c.fd < 0) continue;
+                c.started.push_back(int64_t(next_due));
+                c.unsent++;
+                pump(c);
+                break;
+            }
+            next_due += interval;
+        }
+        itimerspec ts{};
+        auto due = int64_t(next_due);
+        ts.it_value.tv_sec = due/1000000000;
+        ts.it_value.tv_nsec = due%1000000000;
+        if (next_due < double(t_end)) timerfd_settime(tfd, TFD_TIMER_ABSTIME, &ts, nullptr);
+    };
+    auto on_connected = [&](load_conn& c, int64_t now) {
+        c.connected = true;
+        if (!open_loop) {
+            // closed loop: the first requests leave once the run begins
+            for (int i = 0; i < cfg.depth; i++) c.started.push_back(max(now, t_begin));
+            c.unsent += size_t(cfg.depth);
+        }
+        if (now >= t_begin) pump(c);
+    };
+
+    vector<epoll_event> events(256);
+    bool started = false;
+    while (true) {
+        int64_t now = now_ns();
+        if (now >= t_end) break;
+        if (!started && now >= t_begin) {
+            started = true;
+            if (open_loop) {
+                schedule(now);
+            } else {
+                for (auto& c : conns) pump(c);
+            }
+        }
+        int timeout = started ? int((t_end - now)/1000000) + 1 : int((t_begin - now)/1000000) + 1;
+        int n = epoll_wait(epfd, events.data(), int(events.size()), timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("epoll_wait failed");
+            break;
+        }
+        now = now_ns();
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u64 == UINT64_MAX) {
+                uint64_t ticks;
+                if (read(tfd, &ticks, sizeof(ticks)) < 0 && errno != EAGAIN) log_error("timerfd read failed");
+                if (started) schedule(now);
+                continue;
+            }
+            load_conn& c = conns[events[i].data.u64];
+            if (c.fd < 0) continue;
+            if (!c.connected) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0 || (events[i].events & (EPOLLERR|EPOLLHUP))) {
+                    stats.connect_failures++;
+                    close(c.fd);
+                    c.fd = -1;
+                    continue;
+                }
+                on_connected(c, now);
+                if (c.fd < 0) continue;
+            }
+            if (events[i].events & EPOLLOUT) pump(c);
+            if (c.fd < 0 || !(events[i].events & (EPOLLIN|EPOLLERR|EPOLLHUP))) continue;
+            bool closed = false;
+            while (c.fd >= 0) {
+                size_t space;
+                char* p = c.parser.prepare(64*1024, space);
+                ssize_t r = read(c.fd, p, space);
+                if (r < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno != EAGAIN) closed = true;
+                    break;
+                }
+                if (r == 0) {
+                    closed = true;
+                    break;
+                }
+                stats.bytes_in += size_t(r);
+                c.parser.commit(size_t(r));
+                c.parser.drain([&](const frame& f) {
+                    if (c.inflight() == 0) return true;
+                    if (cfg.sort) {
+                        if (f.op == frame_op::sort_records) {
+                            if (c.sorted == 0 && c.started.front() >= t_measure) {
+                                stats.first_batch.record(uint64_t(max<int64_t>(now - c.started.front(), 0)));
+                            }
+                            size_t n = f.payload.size()/sizeof(sort_record);
+                            for (size_t i = 0; i < n; i++) {
+                                sort_record r;
+                                memcpy(&r, f.payload.data() + i*sizeof(r), sizeof(r));
+                                c.in_order = c.in_order && r.key >= c.last_key;
+                                c.last_key = r.key;
+                            }
+                            c.sorted += n;
+                            return true;
+                        }
+                        if (f.op != frame_op::sort_end) return true;
+                        uint64_t count = 0;
+                        if (f.payload.size() == sizeof(count)) memcpy(&count, f.payload.data(), sizeof(count));
+                        if (!c.in_order || c.sorted != cfg.sort || be64toh(count) != cfg.sort) stats.wrong++;
+                        c.sorted = 0;
+                        c.last_key = 0;
+                        c.in_order = true;
+                    } else if (cfg.framing == frame_mode::length_prefixed && f.op != frame_op::ack) {
+                        return true;
+                    }
+                    int64_t begin = c.started.front();
+                    c.started.pop_front();
+                    stats.acked.store(stats.acked.load(memory_order_relaxed) + 1, memory_order_relaxed);
+                    if (begin >= t_measure) {
+                        stats.latency.record(uint64_t(max<int64_t>(now - begin, 0)));
+                        stats.completed.store(stats.completed.load(memory_order_relaxed) + 1, memory_order_relaxed);
+                    }
+                    if (!open_loop && now < t_end) {
+                        c.started.push_back(now);
+                        c.unsent++;
+                    }
+                    return true;
+                });
+                if (c.parser.failed()) {
+                    closed = true;
+                    break;
+                }
+            }
+            if (closed) {
+                drop(c);
+                continue;
+            }
+            pump(c);
+        }
+    }
+    for (auto& c : conns) {
+        if (c.fd < 0) continue;
+        stats.backlog += c.unsent;
+        stats.unanswered += c.inflight();
+        close(c.fd);
+    }
+    close(tfd);
+    close(epfd);
+}
+
+string json_escape(const string& s) {
+    string out;
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') out += '\\';
+        out += ch;
+    }
+    return out;
+}
+
+/**
+ * usage: see the top of the file
+ */
+int main(int argc, const char** argv) {
+    load_config cfg;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq);
+        string value = eq == string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--host" && !value.empty()) {
+            cfg.host = value;
+        } else if (key == "--port") {
+            cfg.port = atoi(value.c_str());
+        } else if (key == "--conns" && atoi(value.c_str()) > 0) {
+            cfg.conns = atoi(value.c_str());
+        } else if (key == "--threads" && atoi(value.c_str()) > 0) {
+            cfg.threads = unsigned(atoi(value.c_str()));
+        } else if (key == "--size") {
+            cfg.size = size_t(atol(value.c_str()));
+        } else if (key == "--depth" && atoi(value.c_str()) > 0) {
+            cfg.depth = atoi(value.c_str());
+        } else if (key == "--rate") {
+            cfg.rate = atof(value.c_str());
+        } else if (key == "--duration" && atof(value.c_str()) > 0) {
+            cfg.duration = atof(value.c_str());
+        } else if (key == "--warmup") {
+            cfg.warmup = max(0.0, atof(value.c_str()));
+        } else if (key == "--framing") {
+            cfg.framing = value == "line" ? frame_mode::delimited : frame_mode::length_prefixed;
+        } else if (key == "--tag") {
+            cfg.tag = value;
+        } else if (key == "--csv") {
+            cfg.csv_path = value;
+        } else if (key == "--json") {
+            cfg.json_path = value;
+        } else if (key == "--sort") {
+            cfg.sort = size_t(atol(value.c_str()));
+        } else {
+            cerr << "usage: " << argv[0] << " [--host=::1] [--port=5000] [--conns=1000] [--threads=N] [--size=64]"
+                 " [--depth=1] [--rate=0] [--duration=10] [--warmup=1] [--framing=length|line] [--tag=label]"
+                 " [--csv=results.csv] [--json=results.json] [--sort=records]" << endl;
+            return 1;
+        }
+    }
+    cfg.threads = min(cfg.threads, unsigned(cfg.conns));
+
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < rlim_t(cfg.conns) + 64) {
+        lim.rlim_cur = min(lim.rlim_max, rlim_t(cfg.conns) + 64);
+        if (setrlimit(RLIMIT_NOFILE, &lim) < 0) log_error("setrlimit RLIMIT_NOFILE failed");
+    }
+    sockaddr_storage addr;
+    socklen_t addr_len;
+    if (!load_resolve(cfg, addr, addr_len)) return 1;
+
+    // connections are set up during the first second, then the warmup, then the measured window
+    int64_t t_begin = now_ns() + 1000000000;
+    int64_t t_measure = t_begin + int64_t(cfg.warmup*1e9);
+    int64_t t_end = t_measure + int64_t(cfg.duration*1e9);
+    vector<unique_ptr<load_stats>> stats;
+    vector<thread> workers;
+    for (unsigned t = 0; t < cfg.threads; t++) {
+        int nconns = cfg.conns/int(cfg.threads) + (int(t) < cfg.conns%int(cfg.threads) ? 1 : 0);
+        stats.emplace_back(new load_stats);
+        workers.emplace_back(load_thread, cref(cfg), cref(addr), addr_len, nconns,
+                             t_begin, t_measure, t_end, ref(*stats.back()));
+    }
+
+    // progress once a second
+    uint64_t last = 0;
+    for (int64_t tick = t_begin + 1000000000; tick < t_end; tick += 1000000000) {
+        this_thread::sleep_for(chrono::nanoseconds(tick - now_ns()));
+        uint64_t acked = 0;
+        for (auto& s : stats) acked += s->acked.load(memory_order_relaxed);
+        INFO((tick <= t_measure ? "warmup " : "") << (acked - last) << " acks/s");
+        last = acked;
+    }
+    for (auto& w : workers) w.join();
+
+    hdr_histogram latency, first_batch;
+    load_stats total;
+    for (auto& s : stats) {
+        latency.merge(s->latency);
+        first_batch.merge(s->first_batch);
+        total.wrong += s->wrong;
+        total.sent += s->sent;
+        total.bytes_out += s->bytes_out;
+        total.bytes_in += s->bytes_in;
+        total.errors += s->errors;
+        total.connect_failures += s->connect_failures;
+        total.backlog += s->backlog;
+        total.unanswered += s->unanswered;
+    }
+    uint64_t completed = latency.count();
+    double throughput = double(completed)/cfg.duration;
+    auto us = [](uint64_t ns) { return double(ns)/1000.0; };
+    const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+    const char* const labels[] = {"p50", "p90", "p99", "p99.9", "p99.99"};
+
+    cout << fixed << setprecision(1)
+         << (cfg.rate > 0 ? "open loop " : "closed loop ") << cfg.conns << " connections, ";
+    if (cfg.sort) {
+        cout << "sorts of " << cfg.sort << " records";
+    } else {
+        cout << cfg.size << " byte requests";
+    }
+    cout << ", depth " << cfg.depth;
+    if (cfg.rate > 0) cout << ", target " << cfg.rate << " req/s";
+    cout << "\n  throughput " << throughput << " req/s over " << cfg.duration << " s";
+    if (cfg.sort) cout << ", " << throughput*double(cfg.sort)/1e6 << " M records/s";
+    cout << "\n  latency us: min " << us(latency.min()) << "  mean " << us(uint64_t(latency.mean()));
+    for (int i = 0; i < 5; i++) cout << "  " << labels[i] << " " << us(latency.value_at(percentiles[i]));
+    cout << "  max " << us(latency.max()) << "\n";
+    if (cfg.sort) {
+        cout << "  first sorted batch us: mean " << us(uint64_t(first_batch.mean()));
+        for (int i = 0; i < 3; i++) cout << "  " << labels[i] << " " << us(first_batch.value_at(percentiles[i]));
+        cout << "  max " << us(first_batch.max()) << "\n"
+             << "  wrong replies " << total.wrong << "\n";
+    }
+    cout << "  sent " << total.sent << "  errors " << total.errors << "  connect failures " << total.connect_failures
+         << "  never sent " << total.backlog << "  unanswered " << total.unanswered << endl;
+
+    if (!cfg.csv_path.empty()) {
+        // one row per run - append so runs collect in one file
+        bool header = true;
+        {
+            ifstream in(cfg.csv_path);
+            header = !in.good() || in.peek() == ifstream::traits_type::eof();
+        }
+        ofstream out(cfg.csv_path, ios::app);
+        if (header) {
+            out << "tag,mode,conns,size,depth,rate,duration,completed,throughput,min_us,mean_us,"
+                   "p50_us,p90_us,p99_us,p99.9_us,p99.99_us,max_us,errors,connect_failures,never_sent,unanswered\n";
+        }
+        out << fixed << setprecision(1) << cfg.tag << ',' << (cfg.rate > 0 ? "open" : "closed") << ','
+            << cfg.conns << ',' << cfg.size << ',' << cfg.depth << ',' << cfg.rate << ',' << cfg.duration << ','
+            << completed << ',' << throughput << ',' << us(latency.min()) << ',' << us(uint64_t(latency.mean()));
+        for (double p : percentiles) out << ',' << us(latency.value_at(p));
+        out << ',' << us(latency.max()) << ',' << total.errors << ',' << total.connect_failures << ','
+            << total.backlog << ',' << total.unanswered << '\n';
+        if (!out) cerr << "cannot write " << cfg.csv_path << endl;
+    }
+    if (!cfg.json_path.empty()) {
+        ofstream out(cfg.json_path);
+        out << fixed << setprecision(3)
+            << "{\n  \"tag\": \"" << json_escape(cfg.tag) << "\",\n"
+            << "  \"config\": {\"host\": \"" << json_escape(cfg.host) << "\", \"port\": " << cfg.port
+            << ", \"conns\": " << cfg.conns << ", \"threads\": " << cfg.threads << ", \"size\": " << cfg.size
+            << ", \"depth\": " << cfg.depth << ", \"rate\": " << cfg.rate << ", \"duration\": " << cfg.duration
+            << ", \"warmup\": " << cfg.warmup << ", \"sort\": " << cfg.sort
+            << ", \"framing\": \"" << (cfg.framing == frame_mode::delimited ? "line" : "length") << "\"},\n"
+            << "  \"completed\": " << completed << ",\n"
+            << "  \"throughput\": " << throughput << ",\n"
+            << "  \"sent\": " << total.sent << ",\n"
+            << "  \"bytes_out\": " << total.bytes_out << ",\n"
+            << "  \"bytes_in\": " << total.bytes_in << ",\n"
+            << "  \"errors\": " << total.errors << ",\n"
+            << "  \"connect_failures\": " << total.connect_failures << ",\n"
+            << "  \"never_sent\": " << total.backlog << ",\n"
+            << "  \"unanswered\": " << total.unanswered << ",\n"
+            << "  \"wrong\": " << total.wrong << ",\n"
+            << "  \"latency_us\": {\"min\": " << us(latency.min()) << ", \"mean\": " << us(uint64_t(latency.mean()));
+        for (int i = 0; i < 5; i++) out << ", \"" << labels[i] << "\": " << us(latency.value_at(percentiles[i]));
+        out << ", \"max\": " << us(latency.max()) << "},\n"
+            << "  \"histogram_us\": [";
+        // the full distribution: upper bound of every bucket and its count
+        bool first = true;
+        latency.for_each_bucket([&](uint64_t, uint64_t high, uint64_t n) {
+            out << (first ? "" : ", ") << "[" << us(high) << ", " << n << "]";
+            first = false;
+        });
+        out << "]\n}\n";
+        if (!out) cerr << "cannot write " << cfg.json_path << endl;
+    }
+    return total.connect_failures == uint64_t(cfg.conns) ? 1 : 0;
+}
@@ -0,0 +1,483 @@
+/**
+ * @file net_log.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Asynchronous logging for the network demos. TRACE/INFO/WARN/ERROR
+ *      encode their arguments as binary records into a lock free ring of the
+ *      calling thread; one background thread formats and writes them in
+ *      batches. Levels below NET_LOG_MIN_LEVEL are compiled out, the rest cost
+ *      a relaxed load when disabled at runtime.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_LOG_HXX_
+#define _NET_LOG_HXX_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+enum class log_level : uint8_t { trace = 0, info, warn, error, off };
+
+// levels below this one are not compiled in: -DNET_LOG_MIN_LEVEL=1 drops TRACE
+#ifndef NET_LOG_MIN_LEVEL
+#define NET_LOG_MIN_LEVEL 0
+#endif
+
+#define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)    // only show filename and not it's path (less clutter)
+
+/**
+ * Where a log statement is - one constant per statement, records only point at it
+ */
+struct log_site {
+    const char* file;
+    const char* function;
+    int line;
+};
+
+constexpr int log_min_level = NET_LOG_MIN_LEVEL;
+
+constexpr bool log_compiled(log_level level) {
+    return int(level) >= log_min_level;
+}
+
+inline atomic_int log_runtime_level{int(log_level::info)};
+
+inline bool log_enabled(log_level level) {
+    return int(level) >= log_runtime_level.load(memory_order_relaxed);
+}
+
+inline void log_set_level(log_level level) {
+    log_runtime_level.store(int(level), memory_order_relaxed);
+}
+
+// order of the records across threads - a record stamped after another one that
+// happened before it (a join, a lock) always gets the larger number
+inline atomic_uint64_t log_sequence{0};
+
+/**
+ * @brief Single producer single consumer byte ring of one thread's records \
+ *      each record is a 4 byte length and the record bytes, either may wrap.
+ */
+class log_ring {
+public:
+    explicit log_ring(size_t capacity) : buf_(new char[capacity]), mask_(capacity - 1) {}
+
+    /**
+     * @return false when the ring is full - the record is dropped, the thread never waits
+     */
+    bool push(const char* rec, uint32_t len) {
+        uint64_t tail = tail_.load(memory_order_relaxed);
+        size_t need = sizeof(len) + len;
+        if (mask_ + 1 - (tail - head_cache_) < need) {
+            head_cache_ = head_.load(memory_order_acquire);
+            if (mask_ + 1 - (tail - head_cache_) < need) return false;
+        }
+        copy_in(tail, &len, sizeof(len));
+        copy_in(tail + sizeof(len), rec, len);
+        tail_.store(tail + need, memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Consumer side: hand every record to f(const char*, uint32_t)
+     * @return number of records
+     */
+    template<typename F>
+    size_t drain(vector<char>& scratch, F f) {
+        uint64_t head = head_.load(memory_order_relaxed);
+        uint64_t tail = tail_.load(memory_order_acquire);
+        size_t n = 0;
+        while (head != tail) {
+            uint32_t len;
+            copy_out(head, &len, sizeof(len));
+            if (scratch.size() < len) scratch.resize(len);
+            copy_out(head + sizeof(len), scratch.data(), len);
+            head += sizeof(len) + len;
+            f(scratch.data(), len);
+            n++;
+        }
+        head_.store(head, memory_order_release);
+        return n;
+    }
+
+    bool empty() const {
+        return head_.load(memory_order_relaxed) == tail_.load(memory_order_acquire);
+    }
+
+    atomic_bool closed{false};      // the producing thread is gone
+
+private:
+    void copy_in(uint64_t at, const void* src, size_t n) {
+        size_t pos = size_t(at) & mask_;
+        size_t first = min(n, mask_ + 1 - pos);
+        memcpy(buf_.get() + pos, src, first);
+        memcpy(buf_.get(), static_cast<const char*>(src) + first, n - first);
+    }
+    void copy_out(uint64_t at, void* dst, size_t n) const {
+        size_t pos = size_t(at) & mask_;
+        size_t first = min(n, mask_ + 1 - pos);
+        memcpy(dst, buf_.get() + pos, first);
+        memcpy(static_cast<char*>(dst) + first, buf_.get(), n - first);
+    }
+
+    unique_ptr<char[]> buf_;
+    size_t mask_;
+    alignas(64) atomic_uint64_t head_{0};
+    alignas(64) atomic_uint64_t tail_{0};
+    uint64_t head_cache_ = 0;           // producer's view of head_
+};
+
+/**
+ * Argument type tags of a binary record
+ */
+enum class log_arg : uint8_t { i64, u64, f64, chr, str };
+
+/**
+ * Fixed part of a binary record, the tagged arguments follow
+ */
+struct log_record_header {
+    uint64_t seq;               // log_sequence - records are written in this order
+    int64_t sec;                // coarse wall clock, only printed
+    int32_t nsec;
+    log_level level;
+    const log_site* site;
+};
+
+/**
+ * @brief The background thread: collects the records of every thread, formats \
+ *      them and writes each batch with one write(2) to stderr.
+ */
+class log_backend {
+public:
+    static constexpr size_t ring_size = 256*1024;
+
+    static log_backend& instance() {
+        static log_backend backend;
+        return backend;
+    }
+
+    /**
+     * @brief The calling thread's ring, registered on first use
+     */
+    log_ring& thread_ring() {
+        struct holder {
+            shared_ptr<log_ring> ring;
+            ~holder() {
+                if (ring) ring->closed = true;
+            }
+        };
+        thread_local holder tls;
+        if (!tls.ring) {
+            tls.ring = make_shared<log_ring>(ring_size);
+            lock_guard<mutex> lk(rings_mtx_);
+            rings_.push_back(tls.ring);
+        }
+        return *tls.ring;
+    }
+
+    void dropped() { dropped_.fetch_add(1, memory_order_relaxed); }
+
+    /**
+     * @brief A record was pushed (or dropped) - wake the background thread if it sleeps. \
+     *      Costs a fence and a load while it is busy draining.
+     */
+    void wake() {
+        // pairs with the fence in loop(): either we see it asleep, or it sees our record
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!sleeping_.load(memory_order_relaxed)) return;
+        {
+            lock_guard<mutex> lk(sleep_mtx_);
+            pending_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    /**
+     * @brief Write out everything logged so far
+     */
+    void flush() {
+        lock_guard<mutex> lk(drain_mtx_);
+        drain_all();
+    }
+
+    ~log_backend() {
+        {
+            lock_guard<mutex> lk(sleep_mtx_);
+            run_ = false;
+        }
+        cv_.notify_one();
+        if (thx_.joinable()) thx_.join();
+        flush();
+    }
+
+private:
+    log_backend() : thx_([this] { loop(); }) {}
+
+    void loop() {
+        while (run_) {
+            size_t n;
+            {
+                lock_guard<mutex> lk(drain_mtx_);
+                n = drain_all();
+            }
+            if (n == 0) {
+                unique_lock<mutex> lk(sleep_mtx_);
+                sleeping_.store(true, memory_order_relaxed);
+                atomic_thread_fence(memory_order_seq_cst);
+                // a record pushed before the flag was visible is found here instead
+                if (!pending_ && !any_records()) {
+                    cv_.wait(lk, [this] { return pending_ || !run_; });
+                }
+                pending_ = false;
+                sleeping_.store(false, memory_order_relaxed);
+            }
+        }
+    }
+
+    bool any_records() {
+        lock_guard<mutex> lk(rings_mtx_);
+        for (auto& ring : rings_) {
+            if (!ring->empty()) return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Collect every ring, merge the batch by sequence number, write it out
+     * @return records written
+     */
+    size_t drain_all() {
+        vector<shared_ptr<log_ring>> rings;
+        {
+            lock_guard<mutex> lk(rings_mtx_);
+            // rings of finished threads go once they are drained below
+            for (size_t i = 0; i < rings_.size(); ) {
+                rings.push_back(rings_[i]);
+                if (rings_[i]->closed && rings_[i].use_count() == 2) {
+                    rings_.erase(rings_.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+        }
+        batch_.clear();
+        order_.clear();
+        for (auto& ring : rings) {
+            ring->drain(scratch_, [this](const char* rec, uint32_t len) {
+                log_record_header h;
+                memcpy(&h, rec, sizeof(h));
+                order_.push_back(batch_entry{h.seq, batch_.size(), len});
+                batch_.insert(batch_.end(), rec, rec + len);
+            });
+        }
+        sort(order_.begin(), order_.end(), [](const batch_entry& a, const batch_entry& b) {
+            return a.seq < b.seq;
+        });
+        size_t n = order_.size();
+        for (auto& e : order_) format(batch_.data() + e.at, e.len);
+        uint64_t lost = dropped_.exchange(0, memory_order_relaxed);
+        if (lost) out_ += "[log] " + to_string(lost) + " records dropped - ring full\n";
+        for (size_t at = 0; at < out_.size(); ) {
+            ssize_t w = write(STDERR_FILENO, out_.data() + at, out_.size() - at);
+            if (w <= 0) break;
+            at += size_t(w);
+        }
+        out_.clear();
+        // a burst does not pin its memory to the logger
+        if (batch_.capacity() > keep_size) {
+            vector<char>().swap(batch_);
+            vector<batch_entry>().swap(order_);
+            string().swap(out_);
+        }
+        return n;
+    }
+
+    void format(const char* rec, uint32_t len) {
+        static const char* const names[] = {"TRACE", "INFO", "WARN", "ERROR", "OFF"};
+        log_record_header h;
+        memcpy(&h, rec, sizeof(h));
+        // localtime only once a second
+        if (h.sec != stamp_sec_) {
+            time_t t = time_t(h.sec);
+            tm local;
+            localtime_r(&t, &local);
+            char stamp[32];
+            strftime(stamp, sizeof(stamp), "%y-%m-%d %H:%M:%S", &local);
+            stamp_ = stamp;
+            stamp_sec_ = h.sec;
+        }
+        out_ += stamp_;
+        out_ += " [";
+        out_ += names[int(h.level)];
+        out_ += "] ";
+        out_ += h.site->file;
+        out_ += '(';
+        out_ += h.site->function;
+        out_ += ':';
+        out_ += to_string(h.site->line);
+        out_ += ") >> ";
+        for (size_t at = sizeof(h); at < len; ) {
+            auto tag = log_arg(uint8_t(rec[at++]));
+            if (tag == log_arg::str) {
+                uint16_t n;
+                memcpy(&n, rec + at, sizeof(n));
+                out_.append(rec + at + sizeof(n), n);
+                at += sizeof(n) + n;
+            } else if (tag == log_arg::chr) {
+                out_ += rec[at++];
+            } else {
+                char num[32];
+                int w = 0;
+                if (tag == log_arg::i64) {
+                    int64_t v;
+                    memcpy(&v, rec + at, sizeof(v));
+                    w = snprintf(num, sizeof(num), "%lld", (long long)v);
+                } else if (tag == log_arg::u64) {
+                    uint64_t v;
+                    memcpy(&v, rec + at, sizeof(v));
+                    w = snprintf(num, sizeof(num), "%llu", (unsigned long long)v);
+                } else {
+                    double v;
+                    memcpy(&v, rec + at, sizeof(v));
+                    w = snprintf(num, sizeof(num), "%g", v);
+                }
+                out_.append(num, size_t(max(w, 0)));
+                at += 8;
+            }
+        }
+        out_ += '\n';
+    }
+
+    mutex rings_mtx_;
+    vector<shared_ptr<log_ring>> rings_;
+    struct batch_entry {
+        uint64_t seq;
+        size_t at;
+        uint32_t len;
+    };
+    static constexpr size_t keep_size = 1 << 20;
+
+    mutex drain_mtx_;
+    vector<char> scratch_;
+    vector<char> batch_;
+    vector<batch_entry> order_;
+    string out_;
+    string stamp_;
+    int64_t stamp_sec_ = -1;
+    atomic_uint64_t dropped_{0};
+    atomic_bool run_{true};
+    atomic_bool sleeping_{false};
+    bool pending_ = false;              // wake() was called - sleep_mtx_
+    mutex sleep_mtx_;
+    condition_variable cv_;
+    thread thx_;
+};
+
+/**
+ * @brief One log statement: the arguments are encoded on the stack, the finished \
+ *      record is copied into the thread's ring when the statement ends. Strings \
+ *      are copied (up to the record size), numbers are formatted later.
+ */
+class log_record {
+public:
+    static constexpr size_t max_size = 1024;
+
+    log_record(log_level level, const log_site* site) {
+        timespec now;
+        // the coarse clock is a vDSO read of the last tick - no system call, no rdtsc;
+        // records of one tick are ordered by the sequence number
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        uint64_t seq = log_sequence.fetch_add(1, memory_order_relaxed);
+        log_record_header h{seq, int64_t(now.tv_sec), int32_t(now.tv_nsec), level, site};
+        memcpy(buf_, &h, sizeof(h));
+        len_ = sizeof(h);
+    }
+    log_record(const log_record&) = delete;
+    log_record& operator=(const log_record&) = delete;
+
+    ~log_record() {
+        log_backend& backend = log_backend::instance();
+        if (!backend.thread_ring().push(buf_, uint32_t(len_))) backend.dropped();
+        backend.wake();
+    }
+
+    log_record& operator<<(string_view s) {
+        if (len_ + 3 >= max_size) return *this;
+        auto n = uint16_t(min(s.size(), max_size - len_ - 3));
+        buf_[len_++] = char(log_arg::str);
+        memcpy(buf_ + len_, &n, sizeof(n));
+        memcpy(buf_ + len_ + sizeof(n), s.data(), n);
+        len_ += sizeof(n) + n;
+        return *this;
+    }
+    log_record& operator<<(const char* s) { return *this << string_view(s ? s : "(null)"); }
+    log_record& operator<<(const string& s) { return *this << string_view(s); }
+    log_record& operator<<(char c) {
+        if (len_ + 2 <= max_size) {
+            buf_[len_++] = char(log_arg::chr);
+            buf_[len_++] = c;
+        }
+        return *this;
+    }
+    log_record& operator<<(bool b) { return *this << (b ? "true" : "false"); }
+
+    template<typename T, typename = enable_if_t<is_arithmetic_v<T>>>
+    log_record& operator<<(T v) {
+        if constexpr (is_floating_point_v<T>) {
+            put(log_arg::f64, double(v));
+        } else if constexpr (is_signed_v<T>) {
+            put(log_arg::i64, int64_t(v));
+        } else {
+            put(log_arg::u64, uint64_t(v));
+        }
+        return *this;
+    }
+    template<typename T>
+    log_record& operator<<(const atomic<T>& v) { return *this << v.load(memory_order_relaxed); }
+
+private:
+    template<typename V>
+    void put(log_arg tag, V v) {
+        if (len_ + 1 + sizeof(v) > max_size) return;
+        buf_[len_++] = char(tag);
+        memcpy(buf_ + len_, &v, sizeof(v));
+        len_ += sizeof(v);
+    }
+
+    char buf_[max_size];
+    size_t len_;
+};
+
+#define NET_LOG(LEVEL, MSG) \
+    do { \
+        if constexpr (log_compiled(LEVEL)) { \
+            if (log_enabled(LEVEL)) { \
+                static const log_site log_site_here{__FILENAME__, __FUNCTION__, __LINE__}; \
+                log_record(LEVEL, &log_site_here) << MSG; \
+            } \
+        } \
+    } while (0)
+
+#define TRACE(MSG) NET_LOG(log_level::trace, MSG)
+#define INFO(MSG) NET_LOG(log_level::info, MSG)
+#define WARN(MSG) NET_LOG(log_level::warn, MSG)
+#define ERROR(MSG) NET_LOG(log_level::error, MSG)
+
+#endif // _NET_LOG_HXX_
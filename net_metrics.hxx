@@ -0,0 +1,217 @@
+/**
+ * @file net_metrics.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Runtime metrics for the network demos: single writer counters that a
+ *      reactor bumps without locked instructions, the Prometheus text format and
+ *      a UNIX domain socket endpoint serving it. Readers sum the per thread
+ *      values when they render, the writers never synchronize.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_METRICS_HXX_
+#define _NET_METRICS_HXX_
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "net_histogram.hxx"
+
+using namespace std;
+
+inline uint64_t metrics_now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec)*1000000000u + uint64_t(ts.tv_nsec);
+}
+
+/**
+ * @brief Counter of one writer thread - a plain load and store, readable from any thread
+ */
+class metric_counter {
+public:
+    void add(uint64_t n = 1) { v_.store(v_.load(memory_order_relaxed) + n, memory_order_relaxed); }
+    uint64_t value() const { return v_.load(memory_order_relaxed); }
+
+private:
+    atomic_uint64_t v_{0};
+};
+
+/**
+ * @brief Builds a Prometheus text exposition (format 0.0.4)
+ */
+class metrics_text {
+public:
+    /**
+     * @brief HELP and TYPE lines - once per metric name, before its samples
+     */
+    void family(const string& name, const char* type, const char* help) {
+        out_ += "# HELP " + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+    }
+
+    /**
+     * @param labels already formatted, e.g. shard="0" - empty for none
+     */
+    void sample(const string& name, const string& labels, double value) {
+        char num[32];
+        snprintf(num, sizeof(num), "%.17g", value);
+        out_ += name;
+        if (!labels.empty()) out_ += "{" + labels + "}";
+        out_ += " ";
+        out_ += num;
+        out_ += "\n";
+    }
+
+    /**
+     * @brief A histogram as cumulative le buckets
+     * @param bounds upper bounds in exposed units, ascending
+     * @param scale exposed units per recorded unit (1e-9 for ns recorded, seconds exposed)
+     */
+    void histogram(const string& name, const char* help, const hdr_histogram& h,
+                   const vector<double>& bounds, double scale) {
+        family(name, "histogram", help);
+        // an hdr bucket counts towards the first bound above all of its values
+        vector<uint64_t> cumulative(bounds.size(), 0);
+        h.for_each_bucket([&](uint64_t, uint64_t highest, uint64_t n) {
+            for (size_t i = 0; i < bounds.size(); i++) {
+                if (double(highest)*scale <= bounds[i]) {
+                    cumulative[i] += n;
+                    break;
+                }
+            }
+        });
+        uint64_t running = 0;
+        char le[32];
+        for (size_t i = 0; i < bounds.size(); i++) {
+            running += cumulative[i];
+            snprintf(le, sizeof(le), "%g", bounds[i]);
+            sample(name + "_bucket", string("le=\"") + le + "\"", double(running));
+        }
+        sample(name + "_bucket", "le=\"+Inf\"", double(h.count()));
+        sample(name + "_sum", "", double(h.sum())*scale);
+        sample(name + "_count", "", double(h.count()));
+    }
+
+    const string& str() const { return out_; }
+
+private:
+    string out_;
+};
+
+/**
+ * @brief Serves the metrics on a UNIX domain socket: every connection gets one \
+ *      rendering and is closed. A request starting with "GET" (curl --unix-socket) \
+ *      gets an HTTP/1.0 response, anything else (nc -U) the bare text.
+ */
+class metrics_endpoint {
+public:
+    metrics_endpoint() = default;
+    metrics_endpoint(const metrics_endpoint&) = delete;
+    metrics_endpoint& operator=(const metrics_endpoint&) = delete;
+    ~metrics_endpoint() { stop(); }
+
+    /**
+     * @param render called on the endpoint thread for every request
+     * @return false when the socket cannot be set up (errno tells why)
+     */
+    bool start(const string& path, function<string()> render) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        memcpy(addr.sun_path, path.c_str(), path.size());
+        // a socket left by an earlier run is replaced, any other file is not touched
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                errno = EEXIST;
+                return false;
+            }
+            unlink(path.c_str());
+        }
+        sock_ = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (sock_ < 0 || wake_fd_ < 0 ||
+            bind(sock_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(sock_, 16) < 0) {
+            // stop() only cleans up after a started thread
+            int err = errno;
+            if (sock_ >= 0) close(sock_);
+            if (wake_fd_ >= 0) close(wake_fd_);
+            sock_ = wake_fd_ = -1;
+            errno = err;
+            return false;
+        }
+        path_ = path;
+        render_ = move(render);
+        thx_ = thread([this] { serve(); });
+        return true;
+    }
+
+    void stop() {
+        if (!thx_.joinable()) return;
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t rc = write(wake_fd_, &one, sizeof(one));
+        thx_.join();
+        close(sock_);
+        close(wake_fd_);
+        unlink(path_.c_str());
+        sock_ = wake_fd_ = -1;
+    }
+
+private:
+    void serve() {
+        while (true) {
+            pollfd fds[2] = {{sock_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (fds[1].revents) return;
+            int cli = accept4(sock_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (cli < 0) continue;
+            // the request, if the client sends one, is only looked at for "GET"
+            char req[512];
+            ssize_t n = 0;
+            pollfd pcli = {cli, POLLIN, 0};
+            if (poll(&pcli, 1, 100) > 0) n = recv(cli, req, sizeof(req), MSG_DONTWAIT);
+            string body = render_();
+            string resp;
+            if (n >= 3 && memcmp(req, "GET", 3) == 0) {
+                resp = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                       to_string(body.size()) + "\r\n\r\n";
+            }
+            resp += body;
+            for (size_t at = 0; at < resp.size(); ) {
+                ssize_t w = send(cli, resp.data() + at, resp.size() - at, MSG_NOSIGNAL);
+                if (w <= 0) break;
+                at += size_t(w);
+            }
+            close(cli);
+        }
+    }
+
+    int sock_ = -1;
+    int wake_fd_ = -1;
+    string path_;
+    function<string()> render_;
+    thread thx_;
+};
+
+#endif // _NET_METRICS_HXX_
@@ -0,0 +1,125 @@
+/**
+ * @file net_slab.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Slab allocated object table for the network demos' connection state.
+ *      Objects live in fixed slabs that are never moved or freed while the
+ *      table lives, free slots are chained in a free list, and every slot has
+ *      a generation so a handle (generation and index in 64 bits, what goes
+ *      into epoll_event.data.u64) of a closed connection never reaches the
+ *      connection that took its slot.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_SLAB_HXX_
+#define _NET_SLAB_HXX_
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Table of T in slabs of slab_size slots, at most max_slots of them. \
+ *      A slab is allocated when the free list runs dry - one allocation per \
+ *      slab_size connections, none when a slot is reused.
+ */
+template<typename T, size_t slab_size = 1024>
+class slab_table {
+public:
+    using handle = uint64_t;
+    static constexpr handle nil = ~handle(0);
+
+    explicit slab_table(size_t max_slots) : max_slots_(max_slots) {}
+    slab_table(const slab_table&) = delete;
+    slab_table& operator=(const slab_table&) = delete;
+    ~slab_table() {
+        for (size_t i = 0; i < slabs_.size()*slab_size; i++) {
+            slot& s = at(i);
+            if (s.used) s.object()->~T();
+        }
+    }
+
+    /**
+     * @brief Construct a T in a free slot
+     * @return its handle, nil when the table is full
+     */
+    template<typename... Args>
+    handle insert(Args&&... args) {
+        if (size_ >= max_slots_) return nil;
+        if (free_ == npos) add_slab();
+        uint32_t idx = free_;
+        slot& s = at(idx);
+        free_ = s.next_free;
+        new (s.storage) T(forward<Args>(args)...);
+        s.used = true;
+        size_++;
+        return handle(s.gen) << 32 | idx;
+    }
+
+    /**
+     * @return the object, nullptr when the handle is stale (its slot was erased since)
+     */
+    T* get(handle h) {
+        auto idx = uint32_t(h);
+        if (idx >= slabs_.size()*slab_size) return nullptr;
+        slot& s = at(idx);
+        if (!s.used || s.gen != uint32_t(h >> 32)) return nullptr;
+        return s.object();
+    }
+
+    /**
+     * @brief Destroy the object - the slot's next handle has a new generation
+     */
+    void erase(handle h) {
+        T* obj = get(h);
+        if (!obj) return;
+        auto idx = uint32_t(h);
+        slot& s = at(idx);
+        obj->~T();
+        s.used = false;
+        s.gen++;
+        s.next_free = free_;
+        free_ = idx;
+        size_--;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return slabs_.size()*slab_size; }
+
+private:
+    static constexpr uint32_t npos = ~uint32_t(0);
+
+    struct slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        uint32_t gen = 0;
+        uint32_t next_free = npos;
+        bool used = false;
+
+        T* object() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    slot& at(size_t idx) { return slabs_[idx/slab_size][idx%slab_size]; }
+
+    void add_slab() {
+        size_t base = slabs_.size()*slab_size;
+        slabs_.emplace_back(new slot[slab_size]);
+        // chain the new slots in index order
+        for (size_t i = slab_size; i-- > 0; ) {
+            slabs_.back()[i].next_free = free_;
+            free_ = uint32_t(base + i);
+        }
+    }
+
+    vector<unique_ptr<slot[]>> slabs_;
+    uint32_t free_ = npos;
+    size_t size_ = 0;
+    size_t max_slots_;
+};
+
+#endif // _NET_SLAB_HXX_
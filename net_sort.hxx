@@ -0,0 +1,387 @@
+/**
+ * @file net_sort.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief The sort service of the network demos. A session's records arrive in
+ *      batches and are cut into runs, each sorted with mergeSort() on a shared
+ *      TaskPool while the next one is still being received; a sorted run that
+ *      does not fit the service's memory budget is spilled to a temporary file
+ *      (SortRun). Once the input ends the runs are merged by a loser tree one
+ *      output batch at a time, a few batches ahead of the connection - the first
+ *      sorted records go out while the rest is still being merged.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_SORT_HXX_
+#define _NET_SORT_HXX_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "merge_sort.hxx"
+
+using namespace std;
+
+/**
+ * A record of the sort service: 16 bytes in the host's byte order, ordered by key
+ * only - records with equal keys keep the order they arrived in
+ */
+struct sort_record {
+    uint64_t key;
+    uint64_t value;
+};
+
+inline bool operator<=(const sort_record& a, const sort_record& b) { return a.key <= b.key; }
+
+struct sort_options {
+    size_t run_records = size_t(1) << 20;   // input records sorted as one run (16 MiB)
+    size_t batch_records = 4096;            // records of an output batch (64 KiB)
+    size_t read_records = size_t(1) << 16;  // read buffer of a spilled run while merging
+    size_t ahead_batches = 4;               // merged batches kept ready ahead of the connection
+    string temp_dir = "/tmp";
+};
+
+/**
+ * @brief Memory shared by the sort jobs of a service - sorted runs stay in memory \
+ *      while it lasts and are spilled to disk beyond. The runs still being \
+ *      received are not counted: at most run_records per session.
+ */
+class sort_budget {
+public:
+    explicit sort_budget(size_t bytes) : limit_(bytes) {}
+
+    bool take(size_t n) {
+        size_t used = used_.load(memory_order_relaxed);
+        do {
+            if (used + n > limit_) return false;
+        } while (!used_.compare_exchange_weak(used, used + n, memory_order_relaxed));
+        return true;
+    }
+
+    void give(size_t n) { used_.fetch_sub(n, memory_order_relaxed); }
+    size_t used() const { return used_.load(memory_order_relaxed); }
+
+private:
+    size_t limit_;
+    atomic<size_t> used_{0};
+};
+
+/**
+ * Where the output of a job stands for its connection
+ */
+enum class sort_state : uint8_t {
+    ready,          // next() handed out a batch
+    wait,           // the next batch is being sorted or merged - notify is called when it is there
+    done,           // every record was handed out
+    failed,         // spilling or reading back a run failed, error() tells
+};
+
+/**
+ * @brief One sort of a session. The connection side - add(), finish(), next(), \
+ *      cancel() - is one thread, the reactor's; the sorting and merging run as \
+ *      tasks on the pool, each holding the job (shared_ptr), so a connection that \
+ *      goes away never waits for them. notify is called on a pool thread whenever \
+ *      next() may have something new and must be cheap and thread safe.
+ */
+class sort_job : public enable_shared_from_this<sort_job> {
+public:
+    using batch = vector<sort_record>;
+
+    sort_job(TaskPool& pool, sort_budget& budget, const sort_options& opt, function<void()> notify)
+        : pool_(pool), budget_(budget), opt_(opt), notify_(move(notify)) {
+        opt_.run_records = max<size_t>(opt_.run_records, 1);
+        opt_.batch_records = max<size_t>(opt_.batch_records, 1);
+        opt_.ahead_batches = max<size_t>(opt_.ahead_batches, 1);
+    }
+    sort_job(const sort_job&) = delete;
+    sort_job& operator=(const sort_job&) = delete;
+    ~sort_job() { budget_.give(held_); }
+
+    /**
+     * @brief Take a batch of input records - every full run goes to the pool right away
+     * @return false when the bytes are not whole records
+     */
+    bool add(string_view bytes) {
+        if (bytes.size() % sizeof(sort_record)) return false;
+        size_t n = bytes.size()/sizeof(sort_record);
+        auto p = bytes.data();
+        while (n) {
+            if (input_.empty()) input_.reserve(opt_.run_records);
+            size_t take = min(n, opt_.run_records - input_.size());
+            size_t at = input_.size();
+            input_.resize(at + take);
+            memcpy(input_.data() + at, p, take*sizeof(sort_record));
+            p += take*sizeof(sort_record);
+            n -= take;
+            total_ += take;
+            if (input_.size() == opt_.run_records) submit();
+        }
+        return true;
+    }
+
+    /**
+     * @brief The input is complete - the merge starts once every run is sorted
+     */
+    void finish() {
+        if (!input_.empty()) submit();
+        lock_guard<mutex> lk(lock_);
+        input_done_ = true;
+        if (sorting_ == 0) start_merge();
+    }
+
+    /**
+     * @brief The next batch of sorted records, swapped into out
+     */
+    sort_state next(batch& out) {
+        lock_guard<mutex> lk(lock_);
+        if (!error_.empty()) return sort_state::failed;
+        if (ready_.empty()) return merged_ ? sort_state::done : sort_state::wait;
+        batch used = move(out);
+        out = move(ready_.front());
+        ready_.pop_front();
+        if (used.capacity() && spare_.size() < opt_.ahead_batches) spare_.push_back(move(used));
+        // the merge stopped a few batches ahead - this one made room
+        if (!producing_ && !merged_) {
+            producing_ = true;
+            spawn([](sort_job& job) { job.produce(); });
+        }
+        return sort_state::ready;
+    }
+
+    /**
+     * @brief The connection is done with the job - work not started yet is skipped
+     */
+    void cancel() {
+        lock_guard<mutex> lk(lock_);
+        cancelled_ = true;
+    }
+
+    size_t records() const { return total_; }
+    size_t spilled() const { return spilled_.load(memory_order_relaxed); }
+
+    string error() const {
+        lock_guard<mutex> lk(lock_);
+        return error_;
+    }
+
+private:
+    /**
+     * A sorted run: in memory, or spilled to a file
+     */
+    struct run {
+        batch records;
+        unique_ptr<SortRun> file;
+    };
+
+    /**
+     * A run as the merge reads it
+     */
+    struct source {
+        const sort_record* at = nullptr;
+        const sort_record* end = nullptr;
+        unique_ptr<RunReader<sort_record>> reader;
+
+        bool empty() const { return reader ? reader->empty() : at == end; }
+        const sort_record& head() const { return reader ? reader->head() : *at; }
+        void pop() {
+            if (reader) {
+                reader->pop();
+            } else {
+                ++at;
+            }
+        }
+    };
+
+    /**
+     * Ties go to the earlier run, which keeps the sort stable (as mergeRuns())
+     */
+    struct source_less {
+        const vector<source>* sources;
+
+        bool operator()(size_t a, size_t b) const {
+            const source& x = (*sources)[a];
+            const source& y = (*sources)[b];
+            if (x.empty()) return false;
+            if (y.empty()) return true;
+            return a < b ? x.head() <= y.head() : !(y.head() <= x.head());
+        }
+    };
+
+    template<typename F>
+    void spawn(F f) {
+        pool_.spawn(group_, [self = shared_from_this(), f]() { f(*self); });
+    }
+
+    /**
+     * @brief Hand the received run to the pool
+     */
+    void submit() {
+        size_t idx;
+        {
+            lock_guard<mutex> lk(lock_);
+            idx = runs_.size();
+            runs_.emplace_back();
+            sorting_++;
+        }
+        // a std::function task must be copyable - the records ride in a shared_ptr
+        auto records = make_shared<batch>(move(input_));
+        input_ = batch();
+        spawn([idx, records](sort_job& job) { job.sort_run(idx, move(*records)); });
+    }
+
+    void sort_run(size_t idx, batch records) {
+        run r;
+        string error;
+        if (!is_cancelled()) {
+            try {
+                mergeSort(records.data(), 0, records.size());
+                size_t bytes = records.size()*sizeof(sort_record);
+                if (budget_.take(bytes)) {
+                    r.records = move(records);
+                } else {
+                    r.file = make_unique<SortRun>(opt_.temp_dir);
+                    writeFully(r.file->fd, records.data(), bytes);
+                    r.file->count = records.size();
+                    spilled_.fetch_add(1, memory_order_relaxed);
+                }
+            } catch (const exception& e) {
+                error = e.what();
+            }
+        }
+        bool tell = false;
+        {
+            lock_guard<mutex> lk(lock_);
+            held_ += r.records.size()*sizeof(sort_record);
+            runs_[idx] = move(r);
+            sorting_--;
+            if (!error.empty() && error_.empty()) {
+                error_ = error;
+                tell = true;
+            }
+            if (input_done_ && sorting_ == 0) start_merge();
+        }
+        if (tell) notify_();
+    }
+
+    /**
+     * @brief Every run is sorted - lock_ held
+     */
+    void start_merge() {
+        if (!error_.empty() || cancelled_ || producing_) return;
+        producing_ = true;
+        spawn([](sort_job& job) { job.produce(); });
+    }
+
+    /**
+     * @brief Merge batches until ahead_batches are ready or the runs are exhausted
+     */
+    void produce() {
+        try {
+            if (!tree_) open_sources();
+            for (;;) {
+                batch b;
+                {
+                    lock_guard<mutex> lk(lock_);
+                    if (cancelled_ || ready_.size() >= opt_.ahead_batches) {
+                        producing_ = false;
+                        return;
+                    }
+                    if (!spare_.empty()) {
+                        b = move(spare_.back());
+                        spare_.pop_back();
+                    }
+                }
+                b.clear();
+                b.reserve(opt_.batch_records);
+                bool last = sources_.empty();
+                while (!last && b.size() < opt_.batch_records) {
+                    source& s = sources_[tree_->winner()];
+                    if (s.empty()) {
+                        last = true;
+                        break;
+                    }
+                    b.push_back(s.head());
+                    s.pop();
+                    tree_->replay();
+                }
+                {
+                    lock_guard<mutex> lk(lock_);
+                    if (!b.empty()) ready_.push_back(move(b));
+                    if (last) {
+                        merged_ = true;
+                        producing_ = false;
+                    }
+                }
+                notify_();
+                if (last) return;
+            }
+        } catch (const exception& e) {
+            {
+                lock_guard<mutex> lk(lock_);
+                if (error_.empty()) error_ = e.what();
+                producing_ = false;
+            }
+            notify_();
+        }
+    }
+
+    /**
+     * @brief The merge's view of the runs - they do not change any more once the merge starts
+     */
+    void open_sources() {
+        sources_.resize(runs_.size());
+        for (size_t i = 0; i < runs_.size(); i++) {
+            run& r = runs_[i];
+            if (r.file) {
+                sources_[i].reader = make_unique<RunReader<sort_record>>(r.file->fd, r.file->count,
+                                                                         opt_.read_records);
+            } else {
+                sources_[i].at = r.records.data();
+                sources_[i].end = r.records.data() + r.records.size();
+            }
+        }
+        tree_ = make_unique<LoserTree<source_less>>(max<size_t>(sources_.size(), 1), source_less{&sources_});
+    }
+
+    bool is_cancelled() const {
+        lock_guard<mutex> lk(lock_);
+        return cancelled_;
+    }
+
+    TaskPool& pool_;
+    sort_budget& budget_;
+    sort_options opt_;
+    function<void()> notify_;
+    TaskPool::Group group_;
+    // the connection side
+    batch input_;                       // the run being received
+    size_t total_ = 0;
+    // shared with the tasks
+    mutable mutex lock_;
+    vector<run> runs_;                  // in arrival order
+    size_t sorting_ = 0;                // runs on the pool, not sorted yet
+    size_t held_ = 0;                   // bytes taken from the budget
+    deque<batch> ready_;                // merged batches for next()
+    vector<batch> spare_;               // batches next() is done with, for the merge to refill
+    string error_;
+    bool input_done_ = false;
+    bool producing_ = false;            // a merge task is queued or running
+    bool merged_ = false;               // every record is in ready_ or handed out
+    bool cancelled_ = false;
+    atomic<size_t> spilled_{0};
+    // the merge - one task at a time (producing_)
+    vector<source> sources_;
+    unique_ptr<LoserTree<source_less>> tree_;
+};
+
+#endif // _NET_SORT_HXX_
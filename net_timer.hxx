@@ -0,0 +1,190 @@
+/**
+ * @file net_timer.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Hierarchical timing wheel for the network demos' connection timeouts.
+ *      Four levels of 64 slots; a timer sits in the level its distance falls
+ *      into and cascades one level down every time the level below wraps, so
+ *      insert, reset, cancel and expiry are O(1) and nothing scans the
+ *      connections. Timers are intrusive nodes in the connection state.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_TIMER_HXX_
+#define _NET_TIMER_HXX_
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * @brief A timer, embedded in what it times. It unlinks itself when destroyed; \
+ *      a copy is a new unlinked timer (connection state may be moved before use).
+ */
+struct timer_node {
+    timer_node() = default;
+    timer_node(const timer_node& o) : owner(o.owner) {}
+    timer_node& operator=(const timer_node&) = delete;
+    ~timer_node() { unlink(); }
+
+    bool linked() const { return pprev != nullptr; }
+    void unlink() {
+        if (!pprev) return;
+        *pprev = next;
+        if (next) next->pprev = pprev;
+        pprev = nullptr;
+        next = nullptr;
+    }
+
+    uint64_t owner = 0;             // whatever finds the owner again, e.g. a connection handle
+    uint64_t deadline = 0;          // tick the owner wants the timer to fire at
+    uint64_t expires = 0;           // tick of the slot the timer waits in - deadline moved later is lazy
+    timer_node** pprev = nullptr;   // the link pointing at this node
+    timer_node* next = nullptr;
+};
+
+/**
+ * @brief The wheel counts ticks of the caller's choosing (e.g. 10 ms); the caller \
+ *      advances it to the current tick and asks it how long it may sleep.
+ */
+class timer_wheel {
+public:
+    static constexpr int levels = 4;
+    static constexpr int slot_bits = 6;
+    static constexpr uint64_t slots = uint64_t(1) << slot_bits;
+    static constexpr uint64_t max_ticks = (uint64_t(1) << (slot_bits*levels)) - 1;
+
+    explicit timer_wheel(uint64_t now_tick = 0) : now_(now_tick) {}
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    /**
+     * @brief Arm, or re-arm, a timer to fire at deadline (a tick). Pushing the \
+     *      deadline later only notes it - the timer is moved when its slot comes up.
+     */
+    void schedule(timer_node& n, uint64_t deadline) {
+        n.deadline = deadline;
+        if (n.linked()) {
+            if (n.expires <= deadline) return;
+            n.unlink();
+        }
+        place(n, now_ + 1);
+    }
+
+    void cancel(timer_node& n) { n.unlink(); }
+
+    /**
+     * @brief Move the wheel to now_tick, handing every timer due by then to on_expire(timer_node&). \
+     *      The node is unlinked before the call; the callback may arm it again, cancel or \
+     *      destroy other timers.
+     * @return timers expired
+     */
+    template<typename F>
+    size_t advance(uint64_t now_tick, F&& on_expire) {
+        size_t fired = 0;
+        while (now_ < now_tick) {
+            if (empty()) {
+                now_ = now_tick;
+                break;
+            }
+            now_++;
+            // a lower level wrapped around - the next slot of the level above comes down
+            for (int level = 1; level < levels; level++) {
+                if (now_ & ((uint64_t(1) << (slot_bits*level)) - 1)) break;
+                cascade(level, (now_ >> (slot_bits*level)) & (slots - 1));
+            }
+            size_t idx = now_ & (slots - 1);
+            if (!(occupied_[0] & (uint64_t(1) << idx))) continue;
+            // the slot list moves to a local head, so callbacks may unlink any node
+            take(0, idx);
+            while (local_) {
+                timer_node& n = *local_;
+                n.unlink();
+                if (n.deadline > now_) {
+                    place(n, now_ + 1);
+                } else {
+                    fired++;
+                    on_expire(n);
+                }
+            }
+        }
+        return fired;
+    }
+
+    /**
+     * @return ticks from now() until the wheel has work, -1 when no timer is armed
+     */
+    int64_t next_due() const {
+        if (empty()) return -1;
+        uint64_t best = max_ticks;
+        if (occupied_[0]) {
+            unsigned shift = unsigned((now_ + 1) & (slots - 1));
+            uint64_t rotated = (occupied_[0] >> shift) | (shift ? occupied_[0] << (slots - shift) : 0);
+            best = uint64_t(__builtin_ctzll(rotated)) + 1;
+        }
+        for (int level = 1; level < levels; level++) {
+            if (occupied_[level]) {
+                // the next time level 0 wraps, level 1 cascades (and the levels above in turn)
+                best = min(best, slots - (now_ & (slots - 1)));
+                break;
+            }
+        }
+        return int64_t(best);
+    }
+
+    uint64_t now() const { return now_; }
+
+private:
+    bool empty() const {
+        for (uint64_t bits : occupied_) {
+            if (bits) return false;
+        }
+        return true;
+    }
+
+    /**
+     * @param earliest the first tick whose slot is still to be processed
+     */
+    void place(timer_node& n, uint64_t earliest) {
+        uint64_t when = max(n.deadline, earliest);
+        when = min(when, now_ + max_ticks);
+        uint64_t delta = when - now_;
+        int level = 0;
+        while (level < levels - 1 && delta >= (uint64_t(1) << (slot_bits*(level + 1)))) level++;
+        size_t idx = (when >> (slot_bits*level)) & (slots - 1);
+        n.expires = when;
+        n.next = wheel_[level][idx];
+        if (n.next) n.next->pprev = &n.next;
+        n.pprev = &wheel_[level][idx];
+        wheel_[level][idx] = &n;
+        occupied_[level] |= uint64_t(1) << idx;
+    }
+
+    void take(int level, size_t idx) {
+        local_ = wheel_[level][idx];
+        wheel_[level][idx] = nullptr;
+        occupied_[level] &= ~(uint64_t(1) << idx);
+        if (local_) local_->pprev = &local_;
+    }
+
+    void cascade(int level, size_t idx) {
+        if (!(occupied_[level] & (uint64_t(1) << idx))) return;
+        take(level, idx);
+        while (local_) {
+            timer_node& n = *local_;
+            n.unlink();
+            // the current tick's level 0 slot is processed right after the cascade
+            place(n, now_);
+        }
+    }
+
+    uint64_t now_;
+    timer_node* wheel_[levels][slots] = {};
+    uint64_t occupied_[levels] = {};    // slots with timers, a cancelled timer may leave a bit behind
+    timer_node* local_ = nullptr;       // the list being expired or cascaded
+};
+
+#endif // _NET_TIMER_HXX_
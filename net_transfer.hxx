@@ -0,0 +1,307 @@
+/**
+ * @file net_transfer.hxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Streaming file transfer for the network demos: a 32 byte header with
+ *      the file size and its XXH64 checksum, then the raw bytes. The sender
+ *      hands the file to the socket with sendfile, the receiver moves the bytes
+ *      socket -> pipe -> file with splice, or reads them through one large
+ *      buffer - either way memory use does not grow with the file.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ */
+#ifndef _NET_TRANSFER_HXX_
+#define _NET_TRANSFER_HXX_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+using namespace std;
+
+constexpr uint32_t xfer_magic = 0x4e584631;         // "NXF1"
+constexpr size_t xfer_header_size = 32;
+constexpr size_t xfer_default_chunk = size_t(4) << 20;
+
+/**
+ * @brief Streaming XXH64 (seed 0) - fast enough not to be the bottleneck of a loopback transfer
+ */
+class xxh64 {
+public:
+    void update(const void* data, size_t n) {
+        auto p = static_cast<const unsigned char*>(data);
+        total_ += n;
+        if (fill_ + n < 32) {
+            memcpy(buf_ + fill_, p, n);
+            fill_ += n;
+            return;
+        }
+        if (fill_) {
+            size_t take = 32 - fill_;
+            memcpy(buf_ + fill_, p, take);
+            stripe(buf_);
+            p += take;
+            n -= take;
+            fill_ = 0;
+        }
+        for (; n >= 32; p += 32, n -= 32) stripe(p);
+        memcpy(buf_, p, n);
+        fill_ = n;
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (total_ >= 32) {
+            h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+            for (uint64_t v : v_) h = (h ^ round(0, v))*p1 + p4;
+        } else {
+            h = p5;
+        }
+        h += total_;
+        const unsigned char* p = buf_;
+        size_t n = fill_;
+        for (; n >= 8; p += 8, n -= 8) h = rotl(h ^ round(0, load64(p)), 27)*p1 + p4;
+        if (n >= 4) {
+            uint32_t k;
+            memcpy(&k, p, sizeof(k));
+            h = rotl(h ^ uint64_t(le32toh(k))*p1, 23)*p2 + p3;
+            p += 4;
+            n -= 4;
+        }
+        for (; n; p++, n--) h = rotl(h ^ *p*p5, 11)*p1;
+        h ^= h >> 33;
+        h *= p2;
+        h ^= h >> 29;
+        h *= p3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t p1 = 11400714785074694791ULL;
+    static constexpr uint64_t p2 = 14029467366897019727ULL;
+    static constexpr uint64_t p3 = 1609587929392839161ULL;
+    static constexpr uint64_t p4 = 9650029242287828579ULL;
+    static constexpr uint64_t p5 = 2870177450012600261ULL;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    static uint64_t round(uint64_t acc, uint64_t in) { return rotl(acc + in*p2, 31)*p1; }
+    static uint64_t load64(const unsigned char* p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return le64toh(v);
+    }
+    void stripe(const unsigned char* p) {
+        for (int i = 0; i < 4; i++) v_[i] = round(v_[i], load64(p + 8*i));
+    }
+
+    uint64_t v_[4] = {p1 + p2, p2, 0, 0 - p1};
+    unsigned char buf_[32];
+    size_t fill_ = 0;
+    uint64_t total_ = 0;
+};
+
+/**
+ * @brief The transfer header: magic, flags (0), size and checksum, all in network order
+ */
+inline void xfer_put_header(char* out, uint64_t size, uint64_t checksum) {
+    memset(out, 0, xfer_header_size);
+    uint32_t magic = htobe32(xfer_magic);
+    uint64_t be_size = htobe64(size), be_sum = htobe64(checksum);
+    memcpy(out, &magic, sizeof(magic));
+    memcpy(out + 8, &be_size, sizeof(be_size));
+    memcpy(out + 16, &be_sum, sizeof(be_sum));
+}
+
+/**
+ * @return false when the bytes are not a transfer header
+ */
+inline bool xfer_get_header(const char* in, uint64_t& size, uint64_t& checksum) {
+    uint32_t magic;
+    memcpy(&magic, in, sizeof(magic));
+    if (be32toh(magic) != xfer_magic) return false;
+    memcpy(&size, in + 8, sizeof(size));
+    memcpy(&checksum, in + 16, sizeof(checksum));
+    size = be64toh(size);
+    checksum = be64toh(checksum);
+    return true;
+}
+
+/**
+ * @brief Write everything - a socket may take only part of a write
+ */
+inline bool xfer_write_all(int fd, const void* data, size_t n) {
+    auto p = static_cast<const char*>(data);
+    while (n) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        n -= size_t(w);
+    }
+    return true;
+}
+
+/**
+ * @return false on an error or when the peer closed before n bytes (errno 0)
+ */
+inline bool xfer_read_all(int fd, void* data, size_t n) {
+    auto p = static_cast<char*>(data);
+    while (n) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (r == 0) {
+            errno = 0;
+            return false;
+        }
+        p += r;
+        n -= size_t(r);
+    }
+    return true;
+}
+
+/**
+ * @brief Checksum size bytes of a file through bounded mmap windows, \
+ *      read through one buffer where the file cannot be mapped
+ */
+inline bool xfer_file_checksum(int fd, uint64_t size, uint64_t& checksum, size_t window = size_t(16) << 20) {
+    xxh64 h;
+    for (uint64_t at = 0; at < size; ) {
+        size_t len = size_t(min<uint64_t>(window, size - at));
+        void* map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, off_t(at));
+        if (map == MAP_FAILED) {
+            unique_ptr<char[]> buf(new char[xfer_default_chunk]);
+            for (; at < size; ) {
+                ssize_t r = pread(fd, buf.get(), size_t(min<uint64_t>(xfer_default_chunk, size - at)), off_t(at));
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) return false;
+                h.update(buf.get(), size_t(r));
+                at += uint64_t(r);
+            }
+            break;
+        }
+        madvise(map, len, MADV_SEQUENTIAL);
+        h.update(map, len);
+        munmap(map, len);
+        at += len;
+    }
+    checksum = h.digest();
+    return true;
+}
+
+/**
+ * @brief Send size bytes of a file from offset 0 - sendfile in chunks, resumed after \
+ *      partial writes; a file sendfile does not take goes through pread/write
+ */
+inline bool xfer_send_file(int sock, int fd, uint64_t size, size_t chunk = xfer_default_chunk) {
+    off_t at = 0;
+    while (uint64_t(at) < size) {
+        ssize_t w = sendfile(sock, fd, &at, size_t(min<uint64_t>(chunk, size - uint64_t(at))));
+        if (w < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            if ((errno == EINVAL || errno == ENOSYS) && at == 0) break;
+            return false;
+        }
+        if (w == 0) {
+            // the file shrank under us
+            errno = EIO;
+            return false;
+        }
+    }
+    if (uint64_t(at) == size) return true;
+    unique_ptr<char[]> buf(new char[chunk]);
+    while (uint64_t(at) < size) {
+        ssize_t r = pread(fd, buf.get(), size_t(min<uint64_t>(chunk, size - uint64_t(at))), at);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            if (r == 0) errno = EIO;
+            return false;
+        }
+        if (!xfer_write_all(sock, buf.get(), size_t(r))) return false;
+        at += r;
+    }
+    return true;
+}
+
+/**
+ * @brief Receive size bytes through one buffer of chunk bytes, checksummed on the way
+ * @param out_fd where the bytes go, -1: nowhere (measure the transfer only)
+ */
+inline bool xfer_recv_buffered(int sock, int out_fd, uint64_t size, uint64_t& checksum,
+                               size_t chunk = xfer_default_chunk) {
+    unique_ptr<char[]> buf(new char[chunk]);
+    xxh64 h;
+    for (uint64_t left = size; left; ) {
+        ssize_t r = read(sock, buf.get(), size_t(min<uint64_t>(chunk, left)));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            if (r == 0) errno = ECONNRESET;
+            return false;
+        }
+        h.update(buf.get(), size_t(r));
+        if (out_fd >= 0 && !xfer_write_all(out_fd, buf.get(), size_t(r))) return false;
+        left -= uint64_t(r);
+    }
+    checksum = h.digest();
+    return true;
+}
+
+/**
+ * @brief Move size bytes from the socket into a file with splice through a pipe - the \
+ *      bytes never enter user space, so the checksum is taken from the file afterwards
+ * @param taken bytes taken off the socket, written to the file or not - only a failure \
+ *      with none taken leaves the transfer to another way of receiving
+ */
+inline bool xfer_recv_spliced(int sock, int out_fd, uint64_t size, uint64_t& taken,
+                              size_t chunk = xfer_default_chunk) {
+    taken = 0;
+    int pipe_fd[2];
+    if (pipe2(pipe_fd, O_CLOEXEC) < 0) return false;
+    // a bigger pipe means fewer splice calls; the default is 64 KiB
+    fcntl(pipe_fd[1], F_SETPIPE_SZ, int(min<size_t>(chunk, size_t(1) << 20)));
+    bool ok = true;
+    for (uint64_t left = size; left && ok; ) {
+        ssize_t in = splice(sock, nullptr, pipe_fd[1], nullptr, size_t(min<uint64_t>(chunk, left)),
+                            SPLICE_F_MOVE|SPLICE_F_MORE);
+        if (in < 0 && errno == EINTR) continue;
+        if (in <= 0) {
+            if (in == 0) errno = ECONNRESET;
+            ok = false;
+            break;
+        }
+        left -= uint64_t(in);
+        taken += uint64_t(in);
+        // drain the pipe completely - the next socket splice needs its room
+        while (in > 0) {
+            ssize_t out = splice(pipe_fd[0], nullptr, out_fd, nullptr, size_t(in), SPLICE_F_MOVE|SPLICE_F_MORE);
+            if (out < 0 && errno == EINTR) continue;
+            if (out <= 0) {
+                if (out == 0) errno = EIO;
+                ok = false;
+                break;
+            }
+            in -= out;
+        }
+    }
+    int err = errno;
+    close(pipe_fd[0]);
+    close(pipe_fd[1]);
+    errno = err;
+    return ok;
+}
+
+#endif // _NET_TRANSFER_HXX_
@@ -13,28 +13,94 @@
 #include <fstream>
 #include <thread>
 #include <string>
-#include <iterator>
-#include <regex>
+#include <chrono>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "net_frame.hxx"
+#include "net_transfer.hxx"
 
 using namespace std;
 
 constexpr socklen_t client_buffer_len = 256;
 constexpr int max_srv_connections = 5;
+constexpr size_t file_block_len = 64*1024;
+
+/**
+ * @brief Options of the streaming transfer mode (--stream)
+ */
+struct xfer_config {
+    bool stream = false;            // header + raw bytes instead of text frames
+    string out_path;                // receiver: splice into this file, empty: count and checksum only
+    size_t chunk = xfer_default_chunk;
+    bool verify = true;             // receiver: checksum a spliced file after the transfer
+};
 
 void log_error(string pprefix, string perrmsg) {
     cerr << pprefix << ": " << perrmsg << endl;
 }
 
+/**
+ * @brief Receive one streamed file: the header, then the bytes - spliced into the output \
+ *      file, or read through one large buffer when there is none (or splice is not supported). \
+ *      The client gets "[TRANSFER]:OK" or the reason of the failure.
+ */
+void server_receive_file(int cli_sockfd, const xfer_config& xfer) {
+    char header[xfer_header_size];
+    uint64_t size, checksum, received_sum = 0;
+    if (!xfer_read_all(cli_sockfd, header, sizeof(header)) || !xfer_get_header(header, size, checksum)) {
+        log_error("ERROR", "no transfer header from client");
+        return;
+    }
+    auto start = chrono::steady_clock::now();
+    int out_fd = -1;
+    if (!xfer.out_path.empty()) {
+        // read back for the checksum after splicing
+        out_fd = open(xfer.out_path.c_str(), O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+        if (out_fd < 0) log_error("ERROR", "cannot create " + xfer.out_path + ": " + strerror(errno));
+    }
+    bool ok;
+    bool checked = true;
+    uint64_t spliced = 0;
+    if (out_fd >= 0 && xfer_recv_spliced(cli_sockfd, out_fd, size, spliced, xfer.chunk)) {
+        ok = true;
+        checked = xfer.verify;
+        if (checked) ok = xfer_file_checksum(out_fd, size, received_sum);
+    } else if (spliced) {
+        // splice failed part way - the bytes it took off the socket are gone
+        log_error("ERROR", string("splice failed: ") + strerror(errno));
+        ok = false;
+    } else {
+        ok = xfer_recv_buffered(cli_sockfd, out_fd, size, received_sum, xfer.chunk);
+    }
+    if (out_fd >= 0) close(out_fd);
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    string status;
+    if (!ok) {
+        log_error("ERROR", string("receiving the file: ") + strerror(errno));
+        status = "[TRANSFER]:FAILED\n";
+    } else if (checked && received_sum != checksum) {
+        log_error("ERROR", "checksum mismatch");
+        status = "[TRANSFER]:CHECKSUM MISMATCH\n";
+    } else {
+        status = "[TRANSFER]:OK\n";
+    }
+    if (ok) {
+        std::cout << "[SERVER]: received " << size << " bytes in " << fixed << setprecision(3) << secs << " s ("
+                  << setprecision(1) << (secs > 0 ? double(size)/secs/1e6 : 0.0) << " MB/s), checksum "
+                  << (checked ? (received_sum == checksum ? "ok" : "mismatch") : "not verified") << endl;
+    }
+    xfer_write_all(cli_sockfd, status.data(), status.size());
+}
+
 /**
  * @brief Server thread to receive messages from the client
  * 
  * @param port port number to bind to
  */
-void server_thread(int port) {
+void server_thread(int port, const xfer_config& xfer) {
     int sockfd, cli_sockfd, portno;
     socklen_t cli_addr_len;
-    char client_buffer[client_buffer_len];
     struct sockaddr_in serv_addr, cli_addr;
     int bytes_read;
     ostringstream m;
@@ -47,6 +113,9 @@ void server_thread(int port) {
         serv_addr.sin_family = AF_INET;  
         serv_addr.sin_addr.s_addr = INADDR_ANY;  
         serv_addr.sin_port = htons(portno);
+        // back to back runs - the last run's connection may still be in TIME_WAIT
+        int on = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
 
         if (
             bind(
@@ -63,33 +132,79 @@ void server_thread(int port) {
         if (cli_sockfd < 0) 
             log_error("ERROR", "on accept a new client connection");
 
-        std::cout << "[SERVER]: connection from " << inet_ntoa(cli_addr.sin_addr) << ":" << ntohs(cli_addr.sin_port);
+        std::cout << "[SERVER]: connection from " << inet_ntoa(cli_addr.sin_addr) << ":" << ntohs(cli_addr.sin_port) << endl;
 
-        send(cli_sockfd, "[HANDSHAKE]:WELCOME\n", 13, 0);
+        if (xfer.stream) {
+            server_receive_file(cli_sockfd, xfer);
+            close(cli_sockfd);
+            close(sockfd);
+            return;
+        }
+        send(cli_sockfd, "[HANDSHAKE]:WELCOME\n", 20, 0);
 
-        regex rx_buy(R"((BYEBYE)|(buybuy))");
+        // the client sends data frames and ends with a disconnect frame
+        frame_parser parser(frame_mode::length_prefixed);
         while(client_on){
-                memset(client_buffer, 0, client_buffer_len);
-
-                bytes_read = read(cli_sockfd, client_buffer, client_buffer_len-1);
-                if (bytes_read < 0) log_error("ERROR", "reading from socket");
-                std::cout << "[SERVER] Message from client:" << client_buffer;
-                
-                if(regex_search(string(client_buffer), rx_buy)) {
-                    client_on = false;
+                size_t space;
+                char* pbuf = parser.prepare(client_buffer_len, space);
+                bytes_read = read(cli_sockfd, pbuf, space);
+                if (bytes_read <= 0) {
+                    if (bytes_read < 0) log_error("ERROR", "reading from socket");
+                    break;
                 }
+                parser.commit(bytes_read);
+                client_on = parser.drain([](const frame& f) {
+                    if (f.op == frame_op::disconnect) return false;
+                    std::cout << "[SERVER] Message from client:" << f.payload;
+                    return true;
+                });
+                if (parser.failed()) log_error("ERROR", "malformed frame from client");
         }
         std::cout << "[SERVER]: server thread terminated." << endl;
         close(cli_sockfd);
         close(sockfd);
 }
 
-void client_thread(const string& data_file_path, int port) {
-    int sockfd, portno, bytes_sent;
+/**
+ * @brief Stream one file: header with size and checksum, then sendfile; \
+ *      the server's verdict is the response
+ */
+bool client_send_file(int sockfd, const string& data_file_path, const xfer_config& xfer) {
+    int fd = open(data_file_path.c_str(), O_RDONLY|O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        log_error("[CLIENT ERROR]", "cannot open " + data_file_path + ": " + strerror(errno));
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    uint64_t size = uint64_t(st.st_size), checksum;
+    if (!xfer_file_checksum(fd, size, checksum)) {
+        log_error("[CLIENT ERROR]", string("reading the file: ") + strerror(errno));
+        close(fd);
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    char header[xfer_header_size];
+    xfer_put_header(header, size, checksum);
+    auto start = chrono::steady_clock::now();
+    bool ok = xfer_write_all(sockfd, header, sizeof(header)) && xfer_send_file(sockfd, fd, size, xfer.chunk);
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    close(fd);
+    if (!ok) {
+        log_error("ERROR", string("sending the file: ") + strerror(errno));
+        return false;
+    }
+    cout << "[CLIENT] sent " << size << " bytes in " << fixed << setprecision(3) << secs << " s" << endl;
+    return true;
+}
+
+void client_thread(const string& data_file_path, int port, const xfer_config& xfer) {
+    int sockfd, portno;
     struct sockaddr_in serv_addr;
     struct hostent *server_addr;
 
     char client_buffer[client_buffer_len];
+    string out;
     portno = port;
     sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0) 
@@ -104,37 +219,38 @@ void client_thread(const string& data_file_path, int port) {
     }
     memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
-    memcpy(server_addr->h_addr, 
-         &serv_addr.sin_addr.s_addr,
+    memcpy(&serv_addr.sin_addr.s_addr,
+         server_addr->h_addr,
          server_addr->h_length);
     serv_addr.sin_port = htons(portno);
     if (connect(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
         log_error("ERROR", "connecting");
 
-    memset(client_buffer, 0, client_buffer_len);
-    // read the file and send the contents over
-    ifstream data_file;
-    data_file.open(data_file_path);
-    if (data_file.is_open() && data_file.good()) {
-        istream_iterator<string> it_data_file(data_file);
-        istream_iterator<string> it_data_file_end;
-        ostringstream msg_buff;
-        regex rx(R"(\n)");
-        smatch s;
-        while(it_data_file != it_data_file_end) {
-            string text_line = *it_data_file++;
-            msg_buff << text_line << " ";
-            if (regex_search(text_line, rx)) {
-                msg_buff << endl;
+    if (xfer.stream) {
+        // on a failure the server sees the stream end instead of waiting for the rest
+        if (!client_send_file(sockfd, data_file_path, xfer)) shutdown(sockfd, SHUT_WR);
+    } else {
+        // send the file over in blocks, one data frame each - the memory used is one block
+        ifstream data_file(data_file_path, ios::binary);
+        char block[file_block_len];
+        while (data_file.good()) {
+            data_file.read(block, sizeof(block));
+            if (data_file.gcount() <= 0) break;
+            out.clear();
+            frame_append(out, frame_op::data, string_view(block, size_t(data_file.gcount())));
+            if (!xfer_write_all(sockfd, out.data(), out.size())) {
+                log_error("ERROR", "writing to socket");
+                break;
             }
         }
-        msg_buff.str().c_str();
-        bytes_sent = write(sockfd, msg_buff.str().c_str(), msg_buff.str().length());
+        // the server reads until the disconnect frame
+        out.clear();
+        frame_append(out, frame_op::disconnect);
+        if (!xfer_write_all(sockfd, out.data(), out.size()))
+             log_error("ERROR", "writing to socket");
     }
-    if (bytes_sent < 0) 
-         log_error("ERROR", "writing to socket");
     memset(client_buffer, 0, client_buffer_len);
-    int bytes_rcvd = read(sockfd, client_buffer, 255);
+    int bytes_rcvd = read(sockfd, client_buffer, client_buffer_len - 1);
     if (bytes_rcvd < 0) 
          log_error("ERROR", "reading from socket");
     cout << "[CLIENT] Server response: " << client_buffer << endl;
@@ -144,10 +260,40 @@ void client_thread(const string& data_file_path, int port) {
     cout.flush();
 }
 
+/**
+ * usage: network [--port=35000] [--file=./test.txt] [--stream [--out=path] [--chunk=bytes] [--no-verify]]
+ * --stream sends the file with sendfile behind a size and checksum header, the server
+ * splices it into --out (or only counts and checksums it) and reports the throughput
+ */
 int main(int argc, char** argv, char** env) {
-    thread srv_tx(server_thread, 35000);
+    int port = 35000;
     string data_file_path("./test.txt");
-    thread clt_tx(client_thread, data_file_path, 35000);
+    xfer_config xfer;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq);
+        string value = eq == string::npos ? string() : arg.substr(eq + 1);
+        if (key == "--port" && !value.empty()) {
+            port = atoi(value.c_str());
+        } else if (key == "--file" && !value.empty()) {
+            data_file_path = value;
+        } else if (key == "--stream") {
+            xfer.stream = true;
+        } else if (key == "--out" && !value.empty()) {
+            xfer.out_path = value;
+        } else if (key == "--chunk" && atol(value.c_str()) > 0) {
+            xfer.chunk = size_t(atol(value.c_str()));
+        } else if (key == "--no-verify") {
+            xfer.verify = false;
+        } else {
+            cerr << "usage: " << argv[0] << " [--port=35000] [--file=./test.txt]"
+                 " [--stream [--out=path] [--chunk=bytes] [--no-verify]]" << endl;
+            return 1;
+        }
+    }
+    thread srv_tx(server_thread, port, cref(xfer));
+    thread clt_tx(client_thread, data_file_path, port, cref(xfer));
 
     srv_tx.join();
     clt_tx.join();
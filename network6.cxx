@@ -10,6 +10,17 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <iostream>
 #include <errno.h>
 #include <cstring>
@@ -17,56 +28,132 @@
 #include <iostream>
 #include <ctime>
 #include <iomanip>
-#include <regex>
 #include <atomic>
 #include <thread>
 #include <chrono>
 #include <netdb.h>
-#include <charconv>
-
-#define __FILENAME__ (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)    // only show filename and not it's path (less clutter)
-#define INFO(MSG) \
-    time_now = std::time(nullptr);\
-    std::clog << std::put_time(std::localtime(&time_now), "%y-%m-%d %OH:%OM:%OS") << " [INFO] " \
-    << __FILENAME__ << "(" << __FUNCTION__ << ":" << __LINE__ << ") >> " \
-    << MSG << endl
-#define ERROR(MSG) \
-    time_now = std::time(nullptr); \
-    std::cerr << std::put_time(std::localtime(&time_now), "%y-%m-%d %OH:%OM:%OS") << " [ERROR] " \
-    << __FILENAME__ << "(" << __FUNCTION__ << ":" << __LINE__ << ") >> " \
-    << MSG << endl
-
-static std::time_t time_now = std::time(nullptr);
-
-constexpr int max_concurr_conn = 10;
+#include "net_frame.hxx"
+#include "net_buffer.hxx"
+#include "net_client.hxx"
+#include "net_log.hxx"
+#include "net_metrics.hxx"
+#include "net_slab.hxx"
+#include "net_sort.hxx"
+#include "net_timer.hxx"
+#ifdef __cpp_impl_coroutine
+#include "net_coro.hxx"
+#endif
+#include <memory>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+
 constexpr int cli_conn_timeout = 10000;
 
 using namespace std;
 
 void log_error(string prefix) {
-    string err_msg = strerror(errno);
-    cerr << prefix << ": " << err_msg << endl;
+    ERROR(prefix << ": " << strerror(errno));
 }
 
 atomic_bool srv_run{true};
 
-void srv_thread(int port) {
-    int srvPort = port;
-    int rc;
+/**
+ * I/O backend of the reactors - automatic picks io_uring when the kernel has it
+ */
+enum class srv_backend { automatic, epoll, uring };
+
+/**
+ * Server configuration. The server runs one reactor per shard: every shard owns a
+ * listening socket bound to the same port with SO_REUSEPORT (the kernel spreads the
+ * incoming connections over them) and its own epoll instance, so the shards share nothing.
+ */
+struct srv_config {
+    int port = 5000;
+    unsigned shards = max(1u, thread::hardware_concurrency());
+    int max_conn_per_shard = 32768;     // a shard stops accepting at this many clients
+    int backlog = SOMAXCONN;
+    int max_events = 256;               // events taken from one epoll_wait
+    int accept_batch = 64;              // accepts drained per listener wakeup
+    int wait_timeout_ms = -1;           // epoll_wait timeout, -1 blocks until an event
+    bool pin_cores = true;              // shard i runs on core i % cores
+    srv_backend backend = srv_backend::automatic;
+    unsigned uring_entries = 4096;      // submission queue size
+    unsigned uring_buffers = 4096;      // provided receive buffers per shard, a power of 2
+    unsigned uring_buffer_size = 2048;
+    frame_mode framing = frame_mode::length_prefixed;
+    uint32_t max_frame = frame_default_max;     // larger frames close the connection
+    size_t out_high_water = 64*1024;    // queued output at which a client is not read any more
+    size_t out_limit = 1 << 20;         // queued output at which a client is dropped
+    int idle_timeout_ms = cli_conn_timeout;     // a client silent this long is closed, 0: never
+    int read_timeout_ms = cli_conn_timeout/2;   // a started frame must be complete within, 0: no limit
+    int timer_tick_ms = 10;             // resolution of the timeouts
+    bool timer_fd = false;              // epoll: wake for timeouts on a timerfd, not the epoll_wait timeout
+    bool coro_sessions = false;         // epoll reactor running a coroutine per client (C++20 builds)
+    bool sort_service = false;          // the sessions sort the records they are sent (coroutine sessions)
+    unsigned sort_workers = max(1u, thread::hardware_concurrency());
+    size_t sort_memory = size_t(1) << 30;       // sorted runs held in memory over all sessions, spilled beyond
+    sort_options sort;
+};
+
+/**
+ * The workers and the memory budget of the sort service, shared by the shards
+ */
+struct srv_sorter {
+    explicit srv_sorter(const srv_config& cfg) : budget(cfg.sort_memory), pool(cfg.sort_workers) {}
+
+    sort_budget budget;                 // first - the jobs still queued on the pool give their memory back
+    TaskPool pool;
+};
 
-    sockaddr_storage srv_sockaddr, cli_sockaddr;
+/**
+ * Runtime metrics of a shard - written by its reactor only, summed up when read.
+ * A reactor pass is one epoll_wait (io_uring_enter) return and the work it brings.
+ */
+struct srv_metrics {
+    metric_counter bytes_in;
+    metric_counter bytes_out;
+    metric_counter messages;            // client frames handled
+    metric_counter eagain;              // reads and writes that found the socket not ready (io_uring: ENOBUFS)
+    metric_counter errors;              // clients dropped on an error
+    metric_counter wakeups;             // reactor passes
+    metric_counter timeouts;            // clients closed on an idle or read timeout
+    metric_counter sort_jobs;           // sorts returned completely
+    metric_counter sort_records;        // records of those sorts
+    metric_counter sort_spills;         // runs of those sorts spilled to disk
+    hdr_histogram loop_ns;              // duration of a pass
+    hdr_histogram batch;                // events (completions) of a pass
+    hdr_histogram handle_ns;            // received bytes to their replies queued, every 64th read
+    uint32_t sample_tick = 0;
+};
+
+/**
+ * Per shard state - the counters are read by other threads for reporting only
+ */
+struct srv_shard {
+    unsigned id = 0;
+    int srv_sock = -1;
+    int wake_fd = -1;                   // eventfd - written once to shut the reactor down
+    bool uring = false;                 // io_uring reactor, else epoll
+    shared_ptr<srv_sorter> sorter;      // the sort service, if it runs
+    atomic_int conn_count{0};
+    atomic_uint64_t accepted{0};
+    srv_metrics metrics;
+    thread thx;
+};
+
+/**
+ * Create a listening socket for the port, IPv6 (dual stack) first falling back onto IPv4.
+ * SO_REUSEPORT lets every shard bind its own socket to the same port.
+ */
+int srv_listen_socket(int port, int backlog) {
+    sockaddr_storage srv_sockaddr;
     // It is safe to set the sockadd storage structures to 0 up to the full length
     memset(&srv_sockaddr, 0, sizeof(sockaddr_storage));
-    memset(&cli_sockaddr, 0, sizeof(sockaddr_storage));
-    // the sizes will be determined a bit later first trying IPv6 and falling back onto IPv4
-    socklen_t srv_sockaddr_size = 0, cli_sockaddr_size = 0;
-
+    socklen_t srv_sockaddr_size = 0;
     int on = 1;
-    int family;
 
-    int cli_sock;
-    char buf[INET6_ADDRSTRLEN + 128];
-    
     int srv_sock = socket(AF_INET6, SOCK_STREAM, 0);
     if (srv_sock < 0) {
         // capture the error message which led to socket call to fail
@@ -79,215 +166,1557 @@ void srv_thread(int port) {
             cerr << "Give up and exit." << endl;
             exit (EXIT_FAILURE);
         }
-        // Confirm running Address family IPv4
-        family = AF_INET;
         // adjust the socket address structure match sockaddr_in
         srv_sockaddr_size = sizeof(struct sockaddr_in);
         auto psa = reinterpret_cast<sockaddr_in*>(&srv_sockaddr);
         psa->sin_family = AF_INET;
         psa->sin_addr.s_addr = htonl(INADDR_ANY);
-        psa->sin_port = htons(srvPort);
+        psa->sin_port = htons(port);
     } else {
-        // Confirm running address family IPv6
-        family = AF_INET6;
         // adjust the socket address structure match sockaddr_in6
-        srv_sockaddr_size = sizeof(struct sockaddr_in6);
         auto psa6 = reinterpret_cast<sockaddr_in6*>(&srv_sockaddr);
         psa6->sin6_family = AF_INET6;
         psa6->sin6_addr = in6addr_any;
-        psa6->sin6_port = htons(srvPort);
+        psa6->sin6_port = htons(port);
         srv_sockaddr_size = sizeof(sockaddr_in6);
     }
     int soc_flags = fcntl(srv_sock, F_GETFL, 0);
     fcntl(srv_sock, F_SETFL, soc_flags | O_NONBLOCK);
     clog << "Server socket descriptor " << setw(8) << setfill('0') << srv_sock << endl;
-    rc = setsockopt(srv_sock, SOL_SOCKET, SO_REUSEADDR|SO_REUSEPORT, &on, sizeof(on));
+    // both are SOL_SOCKET options, but option names are not bit flags - one call each
+    if (setsockopt(srv_sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        setsockopt(srv_sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        log_error("setsockopt SO_REUSEADDR/SO_REUSEPORT failed");
+        exit(1);
+    }
 
     // eh, eh we have sockaddr, sockaddr_in, sockaddr_in6, sockaddr_storage, but we always pass in sockaddr pointer
-    rc = bind(srv_sock, (struct sockaddr *)&srv_sockaddr, srv_sockaddr_size);
+    int rc = bind(srv_sock, (struct sockaddr *)&srv_sockaddr, srv_sockaddr_size);
     if (rc < 0) {
         log_error("socket bind failed");
         exit(1);
     }
-    rc = listen(srv_sock, max_concurr_conn);
+    rc = listen(srv_sock, backlog);
     if (rc < 0) {
         log_error("socket listen failed");
         exit(1);
     }
+    return srv_sock;
+}
+
+/**
+ * Raise the open files soft limit towards the hard limit - every client is a descriptor
+ */
+void raise_fd_limit(rlim_t wanted) {
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) < 0) {
+        log_error("getrlimit RLIMIT_NOFILE failed");
+        return;
+    }
+    rlim_t target = min(wanted, lim.rlim_max);
+    if (lim.rlim_cur < target) {
+        lim.rlim_cur = target;
+        if (setrlimit(RLIMIT_NOFILE, &lim) < 0) {
+            log_error("setrlimit RLIMIT_NOFILE failed");
+        }
+    }
+}
+
+/**
+ * Pin the calling thread onto a core (modulo the cores this process may run on)
+ */
+void pin_to_core(unsigned core) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0 || CPU_COUNT(&allowed) == 0) return;
+    int nth = core % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && nth-- == 0) {
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            int rc = pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+            if (rc != 0) {
+                errno = rc;
+                log_error("pthread_setaffinity_np failed");
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * Format a peer address for the log, IPv4 mapped IPv6 addresses are marked as such
+ */
+void format_peer(const sockaddr_storage& cli_sockaddr, char* buf, size_t size) {
+    if (cli_sockaddr.ss_family == AF_INET) {
+        auto psa = reinterpret_cast<const sockaddr_in*>(&cli_sockaddr);
+        inet_ntop(psa->sin_family, &psa->sin_addr, buf, size);
+    } else {
+        auto psa = reinterpret_cast<const sockaddr_in6*>(&cli_sockaddr);
+        inet_ntop(psa->sin6_family, &psa->sin6_addr, buf, size);
+        if (IN6_IS_ADDR_V4MAPPED(&psa->sin6_addr)) {
+            size_t sz = strlen(buf);
+            const char ipv4mapped[] = "+IN6_IS_ADDR_V4MAPPED";
+            if (sz + sizeof(ipv4mapped) < size) {
+                memcpy(&buf[sz], ipv4mapped, sizeof(ipv4mapped));
+            }
+        }
+    }
+}
+
+/**
+ * Reply to a data or disconnect frame: an ack frame, or an "ACK" line for text clients
+ */
+string_view srv_ack(frame_mode mode) {
+    static const string ack_frame = [] {
+        string s;
+        frame_append(s, frame_op::ack);
+        return s;
+    }();
+    return mode == frame_mode::delimited ? string_view("ACK\n") : string_view(ack_frame);
+}
+
+/**
+ * Idle and read timeouts of a client on its shard's timer wheel. Every read pushes the
+ * idle deadline out; a read that leaves part of a frame buffered starts the read
+ * deadline, which goes once nothing is buffered. The timer fires at the earlier one.
+ */
+struct srv_conn_timer {
+    timer_node node;
+    uint64_t read_deadline = 0;         // tick, 0: no partial frame pending
+};
+
+uint64_t srv_tick_ns(const srv_config& cfg) {
+    return uint64_t(max(1, cfg.timer_tick_ms))*1000000;
+}
+
+/**
+ * Re-arm a client's timer after traffic - O(1), a later deadline only notes the new time
+ * @param partial part of a frame is buffered
+ */
+void srv_touch(const srv_config& cfg, timer_wheel& wheel, srv_conn_timer& t, uint64_t tick, bool partial) {
+    auto ticks = [&](int ms) { return (uint64_t(ms) + uint64_t(max(1, cfg.timer_tick_ms)) - 1)/uint64_t(max(1, cfg.timer_tick_ms)); };
+    if (!partial) {
+        t.read_deadline = 0;
+    } else if (t.read_deadline == 0 && cfg.read_timeout_ms > 0) {
+        t.read_deadline = tick + ticks(cfg.read_timeout_ms);
+    }
+    uint64_t deadline = cfg.idle_timeout_ms > 0 ? tick + ticks(cfg.idle_timeout_ms) : UINT64_MAX;
+    if (t.read_deadline) deadline = min(deadline, t.read_deadline);
+    if (deadline == UINT64_MAX) {
+        wheel.cancel(t.node);
+    } else {
+        wheel.schedule(t.node, deadline);
+    }
+}
+
+/**
+ * Why a client's timer fired
+ */
+const char* srv_timeout_reason(const srv_conn_timer& t, const timer_wheel& wheel) {
+    return t.read_deadline && t.read_deadline <= wheel.now() ? "read timeout" : "idle timeout";
+}
+
+enum class frame_action { ack, ack_close, close };
+
+/**
+ * What the server does with a client frame - the same for every backend
+ */
+frame_action srv_handle_frame(const frame& f) {
+    switch (f.op) {
+    case frame_op::data:
+        TRACE(f.payload);
+        return frame_action::ack;
+    case frame_op::disconnect:
+        // as a rule - a separate disconnect message from the client ends the session
+        TRACE("client disconnect request is comming next...");
+        return frame_action::ack_close;
+    default:
+        ERROR("unexpected frame opcode " << int(f.op));
+        return frame_action::close;
+    }
+}
+
+/**
+ * One reactor: blocks in epoll_wait on the shard's listening socket, its clients and
+ * the wake eventfd. Clients are edge triggered and read until EAGAIN; the listener is
+ * level triggered and drained in batches, and disarmed while the shard is full.
+ */
+void srv_epoll_thread(const srv_config& cfg, srv_shard& shard) {
+    vector<epoll_event> events(max(1, cfg.max_events));
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        log_error("epoll_create1 failed");
+        exit(1);
+    }
+    // client state: a slab table entry, its handle is the epoll data of the client
+    struct epoll_conn {
+        int fd;
+        uint64_t self = 0;              // handle in the table
+        frame_parser parser;            // receive buffer, a pool block while bytes are buffered
+        out_ring out;                   // queued replies
+        uint32_t events = 0;            // registered interest
+        bool dirty = false;             // on the flush list of this pass
+        srv_conn_timer timer;
+
+        epoll_conn(int fd, const srv_config& cfg)
+            : fd(fd), parser(cfg.framing, cfg.max_frame), out(cfg.out_limit) {}
+    };
+    using conn_table = slab_table<epoll_conn>;
+    constexpr uint64_t wake_tag = conn_table::nil;
+    constexpr uint64_t listen_tag = conn_table::nil - 1;
+    constexpr uint64_t timer_tag = conn_table::nil - 2;
+    conn_table conns(size_t(cfg.max_conn_per_shard));
+    const uint64_t tick_ns = srv_tick_ns(cfg);
+    uint64_t pass_end = metrics_now_ns();
+    timer_wheel wheel(pass_end/tick_ns);
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = wake_tag;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, shard.wake_fd, &ev);
+    ev.data.u64 = listen_tag;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, shard.srv_sock, &ev);
+    bool listening = true;
+    int timer_fd = -1;
+    uint64_t timer_armed = 0;           // absolute ns the timerfd is set to, 0: disarmed
+    if (cfg.timer_fd) {
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+        if (timer_fd < 0) {
+            log_error("timerfd_create failed - timeouts use the epoll_wait timeout");
+        } else {
+            ev.data.u64 = timer_tag;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+        }
+    }
+    // how long the reactor may block: until the wheel's next tick with work
+    auto wait_timeout = [&]() {
+        int64_t due = wheel.next_due();
+        uint64_t due_ns = due < 0 ? 0 : (wheel.now() + uint64_t(due))*tick_ns;
+        if (timer_fd >= 0) {
+            if (due_ns != timer_armed) {
+                itimerspec its;
+                memset(&its, 0, sizeof(its));
+                its.it_value.tv_sec = time_t(due_ns/1000000000);
+                its.it_value.tv_nsec = long(due_ns%1000000000);
+                timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, nullptr);
+                timer_armed = due_ns;
+            }
+            return cfg.wait_timeout_ms;
+        }
+        if (due < 0) return cfg.wait_timeout_ms;
+        int ms = due_ns > pass_end ? int((due_ns - pass_end + 999999)/1000000) : 0;
+        return cfg.wait_timeout_ms < 0 ? ms : min(cfg.wait_timeout_ms, ms);
+    };
+
+    // stop (or resume) accepting - pending connections stay in the listen backlog
+    auto arm_listener = [&](bool on) {
+        if (on == listening) return;
+        epoll_event lev;
+        memset(&lev, 0, sizeof(lev));
+        lev.events = on ? uint32_t(EPOLLIN) : 0u;
+        lev.data.u64 = listen_tag;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, shard.srv_sock, &lev);
+        listening = on;
+    };
+    vector<uint64_t> dirty;
+    string_view ack = srv_ack(cfg.framing);
+    srv_metrics& m = shard.metrics;
+    uint64_t pass_sent = 0;             // bytes written in this pass
+    auto close_client = [&](epoll_conn& c) {
+        // closing the last reference removes the descriptor from the epoll set, events
+        // of this pass still to come carry a stale handle
+        close(c.fd);
+        conns.erase(c.self);
+        shard.conn_count--;
+        arm_listener(true);
+    };
+    // read while the queued output is below the high water mark, ask for EPOLLOUT while
+    // anything is queued - a client that does not read its replies is not read either
+    auto update_interest = [&](epoll_conn& c) {
+        uint32_t want = EPOLLRDHUP|EPOLLET;
+        if (c.out.size() < cfg.out_high_water) want |= EPOLLIN;
+        if (!c.out.empty()) want |= EPOLLOUT;
+        if (want == c.events) return;
+        epoll_event cev;
+        memset(&cev, 0, sizeof(cev));
+        cev.events = want;
+        cev.data.u64 = c.self;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.fd, &cev);
+        c.events = want;
+    };
+    // the queued replies of every client served in this pass go out together
+    auto flush_dirty = [&]() {
+        for (uint64_t h : dirty) {
+            epoll_conn* pc = conns.get(h);
+            if (!pc || !pc->dirty) continue;
+            epoll_conn& c = *pc;
+            c.dirty = false;
+            flush_result fr = c.out.flush(c.fd, false, &pass_sent);
+            if (fr == flush_result::error) {
+                log_error("client write failed");
+                m.errors.add();
+                close_client(c);
+                continue;
+            }
+            if (fr == flush_result::blocked) m.eagain.add();
+            update_interest(c);
+        }
+        dirty.clear();
+    };
 
-    epoll_event events[max_concurr_conn];
-    int epoll_fd = epoll_create1(0);
-    int conn_count = 0;
+    char buf[INET6_ADDRSTRLEN + 128];
     while (srv_run) {
-        // I will accept new connections only when the total num of active connections
-        // is less than the total number of concurrent connections the kernel can handle
-        // per process.
-        if (conn_count < max_concurr_conn) {
-            static struct epoll_event ev;
-            cli_sock = accept(srv_sock,(struct sockaddr *)&cli_sockaddr, &cli_sockaddr_size);
-            if (cli_sock == -1) {
-                if (errno == EAGAIN) {
-                    // Non blocking - wait again...
-                    INFO("EAGAIN - will continue to wait for new events from clients...");
+        int num_events = epoll_wait(epoll_fd, events.data(), int(events.size()), wait_timeout());
+        if (num_events < 0) {
+            if (errno == EINTR) continue;
+            log_error("epoll_wait failed");
+            break;
+        }
+        uint64_t pass_start = metrics_now_ns();
+        uint64_t tick = pass_start/tick_ns;
+        m.wakeups.add();
+        m.batch.record(uint64_t(num_events));
+        for(int event = 0; event < num_events; event++) {
+            uint64_t tag = events[event].data.u64;
+            if (tag == wake_tag) {
+                // shutdown request - srv_run is already false
+                continue;
+            }
+            if (tag == timer_tag) {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+                    log_error("timerfd read failed");
                 }
-            } else {
-                // new connection. tell the kernel to add to its watch list.
-                conn_count++;
-                ev.events |= (EPOLLIN|EPOLLHUP|EPOLLRDHUP|EPOLLERR);
-                ev.data.fd = cli_sock;
-                int ectl = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, cli_sock, &ev);
-                if (cli_sockaddr.ss_family == AF_INET) {
-                    auto psa = reinterpret_cast<sockaddr_in*>(&cli_sockaddr);
-                    inet_ntop(psa->sin_family, (struct sockaddr *)&psa->sin_addr, buf, sizeof(buf));
-                } else {
-                    auto psa = reinterpret_cast<sockaddr_in6*>(&cli_sockaddr);
-                    inet_ntop(psa->sin6_family, (struct sockaddr *)&psa->sin6_addr, buf, sizeof(buf));
-                    if (IN6_IS_ADDR_V4MAPPED(&psa->sin6_addr)) {
-                        size_t sz = strlen(buf);
-                        const char ipv4mapped[] = "+IN6_IS_ADDR_V4MAPPED";
-                        if (sz + sizeof(ipv4mapped) < sizeof(buf)) {
-                            strncpy(&buf[sz], ipv4mapped, sizeof(ipv4mapped));
+                timer_armed = 0;
+                continue;
+            }
+            if (tag == listen_tag) {
+                for (int n = 0; n < cfg.accept_batch; n++) {
+                    if (shard.conn_count >= cfg.max_conn_per_shard) {
+                        arm_listener(false);
+                        break;
+                    }
+                    sockaddr_storage cli_sockaddr;
+                    socklen_t cli_sockaddr_size = sizeof(cli_sockaddr);
+                    int cli_sock = accept4(shard.srv_sock, (struct sockaddr *)&cli_sockaddr, &cli_sockaddr_size,
+                                           SOCK_NONBLOCK|SOCK_CLOEXEC);
+                    if (cli_sock < 0) {
+                        if (errno == EINTR || errno == ECONNABORTED) continue;
+                        if (errno == EMFILE || errno == ENFILE) {
+                            // out of descriptors - wait for a client to go away
+                            log_error("accept4 failed");
+                            arm_listener(false);
+                        } else if (errno != EAGAIN) {
+                            log_error("accept4 failed");
+                        }
+                        break;
+                    }
+                    // new connection. tell the kernel to add to its watch list.
+                    uint64_t h = conns.insert(cli_sock, cfg);
+                    if (h == conn_table::nil) {
+                        close(cli_sock);
+                        arm_listener(false);
+                        break;
+                    }
+                    epoll_conn& c = *conns.get(h);
+                    c.self = h;
+                    c.timer.node.owner = h;
+                    srv_touch(cfg, wheel, c.timer, tick, false);
+                    shard.conn_count++;
+                    shard.accepted++;
+                    epoll_event cev;
+                    memset(&cev, 0, sizeof(cev));
+                    cev.events = EPOLLIN|EPOLLRDHUP|EPOLLET;
+                    cev.data.u64 = h;
+                    c.events = cev.events;
+                    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, cli_sock, &cev) < 0) {
+                        log_error("epoll_ctl add client failed");
+                        close_client(c);
+                        continue;
+                    }
+                    format_peer(cli_sockaddr, buf, sizeof(buf));
+                    TRACE("shard " << shard.id << ": " << buf);
+                }
+                continue;
+            }
+
+            epoll_conn* pc = conns.get(tag);
+            if (!pc) continue;          // closed earlier in this pass
+            epoll_conn& c = *pc;
+            int fd = c.fd;
+            uint32_t revents = events[event].events;
+            if (revents & EPOLLOUT) {
+                flush_result fr = c.out.flush(fd, false, &pass_sent);
+                if (fr == flush_result::error) {
+                    log_error("client write failed");
+                    m.errors.add();
+                    close_client(c);
+                    continue;
+                }
+                if (fr == flush_result::blocked) m.eagain.add();
+                // below the high water mark again the read interest comes back, and
+                // with it an edge for whatever arrived meanwhile
+                update_interest(c);
+                srv_touch(cfg, wheel, c.timer, tick, c.parser.buffered() > 0);
+            }
+            if (!(c.events & EPOLLIN)) continue;
+
+            // edge triggered - drain the socket, another edge comes only for new data
+            bool closed = false;
+            while (!closed) {
+                if (c.out.size() >= cfg.out_high_water) {
+                    // push out what is queued, more replies follow
+                    if (c.out.flush(fd, true, &pass_sent) == flush_result::error) {
+                        log_error("client write failed");
+                        m.errors.add();
+                        close_client(c);
+                        closed = true;
+                        break;
+                    }
+                    if (c.out.size() >= cfg.out_high_water) {
+                        // the client does not keep up - stop reading until EPOLLOUT
+                        update_interest(c);
+                        break;
+                    }
+                }
+                // read straight into the client's parser - frames are views into it
+                size_t space;
+                char* pbuf = c.parser.prepare(4096, space);
+                ssize_t r = read(fd, pbuf, space);
+                if (r > 0) {
+                    bool timed = (++m.sample_tick & 63) == 0;
+                    uint64_t read_done = timed ? metrics_now_ns() : 0;
+                    m.bytes_in.add(uint64_t(r));
+                    c.parser.commit(size_t(r));
+                    frame_action last = frame_action::ack;
+                    bool overflow = false;
+                    uint64_t frames = 0;
+                    bool keep = c.parser.drain([&](const frame& f) {
+                        frames++;
+                        last = srv_handle_frame(f);
+                        if (last != frame_action::close && !c.out.append(ack.data(), ack.size())) {
+                            overflow = true;
+                            return false;
+                        }
+                        return last == frame_action::ack;
+                    });
+                    m.messages.add(frames);
+                    if (timed) m.handle_ns.record(metrics_now_ns() - read_done);
+                    if (!keep) {
+                        if (c.parser.failed()) {
+                            ERROR("malformed frame - closing the client");
+                            m.errors.add();
+                        } else if (overflow) {
+                            ERROR("client output over " << cfg.out_limit << " bytes - closing the client");
+                            m.errors.add();
+                        } else if (last == frame_action::ack_close) {
+                            // best effort for the last acknowledgement
+                            c.out.flush(fd, false, &pass_sent);
                         }
+                        close_client(c);
+                        closed = true;
+                    } else {
+                        srv_touch(cfg, wheel, c.timer, tick, c.parser.buffered() > 0);
+                        if (!c.dirty && !c.out.empty()) {
+                            c.dirty = true;
+                            dirty.push_back(c.self);
+                        }
+                    }
+                } else if (r == 0) {
+                    // orderly shutdown from the client
+                    TRACE("client disconnect");
+                    close_client(c);
+                    closed = true;
+                } else if (errno == EINTR) {
+                    continue;
+                } else {
+                    if (errno == EAGAIN) {
+                        m.eagain.add();
+                    } else {
+                        log_error("client read failed");
+                        m.errors.add();
+                        close_client(c);
+                        closed = true;
                     }
+                    break;
+                }
+            }
+            if (!closed && revents & (EPOLLHUP|EPOLLERR)) {
+                // a disconnect hit detected - disconnect current client
+                TRACE("client disconnect");
+                close_client(c);
+            }
+        }
+        flush_dirty();
+        m.bytes_out.add(pass_sent);
+        pass_sent = 0;
+        pass_end = metrics_now_ns();
+        // clients that went quiet - their events of this pass have been handled already
+        wheel.advance(pass_end/tick_ns, [&](timer_node& node) {
+            epoll_conn* pc = conns.get(node.owner);
+            if (!pc) return;
+            TRACE("shard " << shard.id << ": " << srv_timeout_reason(pc->timer, wheel) << " - closing the client");
+            m.timeouts.add();
+            close_client(*pc);
+        });
+        m.loop_ns.record(pass_end - pass_start);
+    }
+    if (timer_fd >= 0) close(timer_fd);
+    close(epoll_fd);
+}
+
+#ifdef __cpp_impl_coroutine
+/**
+ * Why a session's connection closes - logged and counted
+ */
+void srv_session_end(const coro_conn& conn, const srv_config& cfg, srv_metrics& m) {
+    switch (conn.status()) {
+    case coro_status::eof:
+        // orderly shutdown from the client
+        TRACE("client disconnect");
+        break;
+    case coro_status::timeout:
+        TRACE((conn.partial_timeout() ? "read timeout" : "idle timeout") << " - closing the client");
+        m.timeouts.add();
+        break;
+    case coro_status::malformed:
+        ERROR("malformed frame - closing the client");
+        m.errors.add();
+        break;
+    case coro_status::overflow:
+        ERROR("client output over " << cfg.out_limit << " bytes - closing the client");
+        m.errors.add();
+        break;
+    case coro_status::error:
+        errno = conn.error();
+        log_error("client I/O failed");
+        m.errors.add();
+        break;
+    case coro_status::open:
+        break;
+    }
+}
+
+/**
+ * A client session as straight line code: every frame is acknowledged, a disconnect
+ * frame ends the session after its acknowledgement. Returning closes the client.
+ */
+coro_session srv_session(coro_conn& conn, const srv_config& cfg, srv_metrics& m) {
+    string_view ack = srv_ack(cfg.framing);
+    while (const frame* f = co_await conn.read(cfg.idle_timeout_ms, cfg.read_timeout_ms)) {
+        m.messages.add();
+        frame_action action = srv_handle_frame(*f);
+        if (action == frame_action::close) break;
+        if (!co_await conn.write(ack) || action == frame_action::ack_close) break;
+    }
+    srv_session_end(conn, cfg, m);
+}
+
+/**
+ * A sort service session: sort_records frames up to a sort_end frame, answered by the
+ * records sorted by key in sort_records frames and a sort_end frame with their count
+ * (8 bytes, network order); then the next sort. The runs are sorted on the service's
+ * pool while the input still arrives, and the merged batches are sent while the merge
+ * goes on - the session only waits for them. A disconnect frame is acknowledged and
+ * ends the session.
+ */
+coro_session srv_sort_session(coro_conn& conn, const srv_config& cfg, srv_shard& shard) {
+    srv_metrics& m = shard.metrics;
+    shared_ptr<coro_mailbox> mailbox = conn.reactor().mailbox();
+    uint64_t self = conn.handle();
+    char header[frame_header_size + sizeof(uint64_t)];
+    for (;;) {
+        auto job = make_shared<sort_job>(shard.sorter->pool, shard.sorter->budget, cfg.sort,
+                                         [mailbox, self] { mailbox->post(self); });
+        const frame* f;
+        while ((f = co_await conn.read(cfg.idle_timeout_ms, cfg.read_timeout_ms))) {
+            m.messages.add();
+            if (f->op != frame_op::sort_records || !job->add(f->payload)) break;
+        }
+        if (!f || f->op != frame_op::sort_end) {
+            job->cancel();
+            if (f && f->op == frame_op::disconnect) {
+                TRACE("client disconnect request is comming next...");
+                co_await conn.write(srv_ack(cfg.framing));
+            } else if (f) {
+                ERROR((f->op == frame_op::sort_records ? "sort batch of " + to_string(f->payload.size()) +
+                       " bytes is not whole records" : "unexpected frame opcode " + to_string(int(f->op))));
+                m.errors.add();
+            }
+            break;
+        }
+        job->finish();
+        sort_job::batch batch;
+        sort_state state;
+        while ((state = job->next(batch)) != sort_state::done && state != sort_state::failed) {
+            if (state == sort_state::wait) {
+                if (!co_await conn.wait_notify()) break;
+                continue;
+            }
+            frame_put_header(header, frame_op::sort_records, uint32_t(batch.size()*sizeof(sort_record)));
+            if (!co_await conn.write(string_view(header, frame_header_size)) ||
+                !co_await conn.write(string_view(reinterpret_cast<const char*>(batch.data()),
+                                                 batch.size()*sizeof(sort_record)))) {
+                break;
+            }
+        }
+        if (state != sort_state::done) {
+            job->cancel();
+            if (state == sort_state::failed) {
+                ERROR("sort of " << job->records() << " records failed: " << job->error());
+                m.errors.add();
+            }
+            break;
+        }
+        m.sort_jobs.add();
+        m.sort_records.add(job->records());
+        m.sort_spills.add(job->spilled());
+        uint64_t count = htobe64(job->records());
+        frame_put_header(header, frame_op::sort_end, sizeof(count));
+        memcpy(header + frame_header_size, &count, sizeof(count));
+        if (!co_await conn.write(string_view(header, sizeof(header)))) break;
+    }
+    srv_session_end(conn, cfg, m);
+}
+
+/**
+ * One reactor running a coroutine session per client on epoll (net_coro.hxx). The
+ * listener and the wake eventfd are handled here, the sessions by the reactor.
+ */
+void srv_coro_thread(const srv_config& cfg, srv_shard& shard) {
+    coro_options opt;
+    opt.framing = cfg.framing;
+    opt.max_frame = cfg.max_frame;
+    opt.out_high_water = cfg.out_high_water;
+    opt.out_limit = cfg.out_limit;
+    opt.max_conns = size_t(cfg.max_conn_per_shard);
+    opt.max_events = cfg.max_events;
+    opt.tick_ms = cfg.timer_tick_ms;
+    coro_reactor reactor(opt);
+    if (!reactor.ok()) {
+        log_error("epoll_create1 failed");
+        exit(1);
+    }
+    const uint64_t wake_tag = coro_reactor::user_tag(0);
+    const uint64_t listen_tag = coro_reactor::user_tag(1);
+    reactor.watch(shard.wake_fd, EPOLLIN, wake_tag);
+    reactor.watch(shard.srv_sock, EPOLLIN, listen_tag);
+    bool listening = true;
+    // stop (or resume) accepting - pending connections stay in the listen backlog
+    auto arm_listener = [&](bool on) {
+        if (on == listening) return;
+        reactor.watch(shard.srv_sock, on ? uint32_t(EPOLLIN) : 0u, listen_tag);
+        listening = on;
+    };
+    srv_metrics& m = shard.metrics;
+    coro_stats seen;
+    char buf[INET6_ADDRSTRLEN + 128];
+    auto on_tag = [&](uint64_t tag, uint32_t) {
+        // the wake eventfd is a shutdown request - srv_run is already false
+        if (tag != listen_tag) return;
+        for (int n = 0; n < cfg.accept_batch; n++) {
+            if (reactor.size() >= size_t(cfg.max_conn_per_shard)) {
+                arm_listener(false);
+                break;
+            }
+            sockaddr_storage cli_sockaddr;
+            socklen_t cli_sockaddr_size = sizeof(cli_sockaddr);
+            int cli_sock = accept4(shard.srv_sock, (struct sockaddr *)&cli_sockaddr, &cli_sockaddr_size,
+                                   SOCK_NONBLOCK|SOCK_CLOEXEC);
+            if (cli_sock < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno == EMFILE || errno == ENFILE) {
+                    // out of descriptors - wait for a client to go away
+                    log_error("accept4 failed");
+                    arm_listener(false);
+                } else if (errno != EAGAIN) {
+                    log_error("accept4 failed");
                 }
-                INFO(buf);
+                break;
+            }
+            format_peer(cli_sockaddr, buf, sizeof(buf));
+            TRACE("shard " << shard.id << ": " << buf);
+            bool spawned = cfg.sort_service ?
+                reactor.spawn(cli_sock, [&](coro_conn& conn) { return srv_sort_session(conn, cfg, shard); }) :
+                reactor.spawn(cli_sock, [&](coro_conn& conn) { return srv_session(conn, cfg, m); });
+            if (!spawned) {
+                log_error("client session setup failed");
+                continue;
             }
+            shard.accepted++;
+            shard.conn_count = int(reactor.size());
         }
-        char buffer[1024];
-        int num_events = epoll_wait(epoll_fd, events, max_concurr_conn, 0);
-        if (num_events > 0) {
-            for(int event = 0; event < num_events; event++) {
-                if (events[event].events & EPOLLIN) {
-                    memset(buffer, 0, sizeof(buffer));
-                    int r = read(events[event].data.fd, buffer, sizeof(buffer));
-                    if (r > 0) {
-                        write(events[event].data.fd, "ACK", 3);
-                        // as a rule - a separate message from the client [buybuy] to terminate
-                        cmatch cm;
-                        std::regex_match ("subject", std::regex("(sub)(.*)") );
-                        if(regex_match(buffer, regex(R"(\[[BbUuYy]{6}\])"))) {
-                            INFO("client disconnect request is comming next...");
-                            struct epoll_event ev;
-                            memcpy(&ev, &events[event], sizeof(epoll_event));
-                            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, events[event].data.fd, &ev);
-                            close(events[event].data.fd);
-                            conn_count--;
+    };
+    while (srv_run) {
+        int num_events = reactor.poll(cfg.wait_timeout_ms, on_tag);
+        if (num_events < 0) {
+            log_error("epoll_wait failed");
+            break;
+        }
+        shard.conn_count = int(reactor.size());
+        if (!listening && reactor.size() < size_t(cfg.max_conn_per_shard)) arm_listener(true);
+        const coro_stats& now = reactor.stats();
+        m.bytes_in.add(now.bytes_in - seen.bytes_in);
+        m.bytes_out.add(now.bytes_out - seen.bytes_out);
+        m.eagain.add(now.eagain - seen.eagain);
+        seen = now;
+        m.wakeups.add();
+        m.batch.record(uint64_t(num_events));
+        m.loop_ns.record(metrics_now_ns() - reactor.woke_ns());
+    }
+}
+#endif
+
+/**
+ * Minimal io_uring ring driven through the raw system calls (no liburing). The
+ * submission and completion rings are mapped once; head and tail are shared with
+ * the kernel through acquire loads and release stores.
+ */
+struct uring {
+    int fd = -1;
+    unsigned sq_entries = 0, cq_entries = 0, features = 0;
+    unsigned *sq_head = nullptr, *sq_tail = nullptr, sq_mask = 0;
+    unsigned *cq_head = nullptr, *cq_tail = nullptr, cq_mask = 0;
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    size_t sq_ring_size = 0, cq_ring_size = 0, sqes_size = 0;
+    unsigned sqe_tail = 0;              // prepared entries, published to the kernel by submit()
+    unsigned sqe_submitted = 0;
+
+    uring() = default;
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+
+    ~uring() {
+        if (sqes) munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+        if (fd >= 0) close(fd);
+    }
+
+    /**
+     * Set the ring up for the calling thread - it must be the only one submitting.
+     * Returns false (errno set) when the kernel has no io_uring.
+     */
+    bool init(unsigned entries, unsigned cq_size) {
+        io_uring_params p;
+        // deferred task running is 6.1+, retry with what older kernels know
+        const unsigned flag_sets[] = {
+            IORING_SETUP_CQSIZE|IORING_SETUP_SUBMIT_ALL|IORING_SETUP_SINGLE_ISSUER|IORING_SETUP_DEFER_TASKRUN,
+            IORING_SETUP_CQSIZE|IORING_SETUP_SUBMIT_ALL|IORING_SETUP_COOP_TASKRUN,
+            IORING_SETUP_CQSIZE
+        };
+        for (unsigned flags : flag_sets) {
+            memset(&p, 0, sizeof(p));
+            p.flags = flags;
+            p.cq_entries = cq_size;
+            fd = int(syscall(__NR_io_uring_setup, entries, &p));
+            if (fd >= 0 || errno != EINVAL) break;
+        }
+        if (fd < 0) return false;
+        features = p.features;
+        sq_entries = p.sq_entries;
+        cq_entries = p.cq_entries;
+
+        sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+        cq_ring_size = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+        if (features & IORING_FEAT_SINGLE_MMAP) sq_ring_size = cq_ring_size = max(sq_ring_size, cq_ring_size);
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED) return false;
+        cq_ring = sq_ring;
+        if (!(features & IORING_FEAT_SINGLE_MMAP)) {
+            cq_ring = mmap(nullptr, cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cq_ring == MAP_FAILED) return false;
+        }
+        sqes_size = p.sq_entries*sizeof(io_uring_sqe);
+        void* psqes = mmap(nullptr, sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (psqes == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(psqes);
+
+        auto sq = static_cast<char*>(sq_ring);
+        auto cq = static_cast<char*>(cq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        // the indirection array maps slot i onto sqe i once and for all
+        auto array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        for (unsigned i = 0; i < p.sq_entries; i++) array[i] = i;
+        sqe_tail = sqe_submitted = *sq_tail;
+        return true;
+    }
+
+    unsigned sq_space() const {
+        return sq_entries - (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE));
+    }
+
+    /**
+     * Next free submission entry, cleared - a full ring is submitted first
+     */
+    io_uring_sqe* get_sqe() {
+        if (sq_space() == 0) submit(0);
+        if (sq_space() == 0) return nullptr;
+        io_uring_sqe* sqe = &sqes[sqe_tail++ & sq_mask];
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    /**
+     * Submit everything prepared and wait for at least wait_nr completions
+     */
+    int submit(unsigned wait_nr) {
+        __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+        unsigned to_submit = sqe_tail - sqe_submitted;
+        unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+        int rc = int(syscall(__NR_io_uring_enter, fd, to_submit, wait_nr, flags, nullptr, 0));
+        if (rc > 0) sqe_submitted += unsigned(rc);
+        return rc;
+    }
+
+    /**
+     * Hand every available completion to f, then release them to the kernel
+     */
+    template<typename F>
+    unsigned for_each_cqe(F f) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (unsigned i = head; i != tail; i++) {
+            f(cqes[i & cq_mask]);
+        }
+        __atomic_store_n(cq_head, tail, __ATOMIC_RELEASE);
+        return tail - head;
+    }
+
+    int reg(unsigned opcode, const void* arg, unsigned nr_args) {
+        return int(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+};
+
+/**
+ * Anonymous page aligned memory - provided buffer rings and registered buffers want pages
+ */
+struct page_block {
+    void* ptr = MAP_FAILED;
+    size_t size = 0;
+
+    explicit page_block(size_t bytes) : size(bytes) {
+        ptr = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0);
+    }
+    page_block(const page_block&) = delete;
+    page_block& operator=(const page_block&) = delete;
+    ~page_block() {
+        if (ptr != MAP_FAILED) munmap(ptr, size);
+    }
+    bool ok() const { return ptr != MAP_FAILED; }
+    char* data() const { return static_cast<char*>(ptr); }
+};
+
+/**
+ * Is an io_uring with provided buffer rings (and so multishot accept/recv, 5.19+) available
+ */
+bool uring_supported() {
+    uring ring;
+    if (!ring.init(8, 16)) return false;
+    page_block br(4096);
+    if (!br.ok()) return false;
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = uint64_t(uintptr_t(br.data()));
+    reg.ring_entries = 1;
+    reg.bgid = 0;
+    if (ring.reg(IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+    return (ring.features & IORING_FEAT_NODROP) && (ring.features & IORING_FEAT_CQE_SKIP);
+}
+
+/**
+ * One reactor on io_uring: a multishot accept hands out direct (fixed) descriptors, a
+ * multishot recv per client picks its buffers from a provided buffer ring, and the
+ * replies are written from a registered buffer. Every submission of a loop pass goes
+ * in with the single io_uring_enter that also waits for the next completions.
+ * Returns false if the ring could not be set up - the caller falls back onto epoll.
+ */
+bool srv_uring_thread(const srv_config& cfg, srv_shard& shard) {
+    // user_data: operation in the top byte, slot generation, fixed file slot
+    enum : uint64_t { op_accept = 1, op_recv, op_send, op_wake, op_timer };
+    auto tag = [](uint64_t op, uint32_t gen, uint32_t slot) {
+        return op << 56 | uint64_t(gen & 0xffffff) << 32 | slot;
+    };
+
+    uring ring;
+    if (!ring.init(cfg.uring_entries, cfg.uring_entries*4)) {
+        log_error("io_uring_setup failed");
+        return false;
+    }
+    // the direct descriptor table holds the clients of this shard. A multishot accept that
+    // finds the table full drops the connection, so the accept is cancelled at the limit and
+    // the slack absorbs what it still takes in before the cancel lands
+    const unsigned slack = 256;
+    rlimit lim;
+    getrlimit(RLIMIT_NOFILE, &lim);
+    unsigned slots = unsigned(min<rlim_t>(rlim_t(cfg.max_conn_per_shard) + slack, lim.rlim_cur));
+    if (slots <= slack) {
+        ERROR("open files limit " << lim.rlim_cur << " is too low for io_uring");
+        return false;
+    }
+    int max_conn = min(cfg.max_conn_per_shard, int(slots - slack));
+    io_uring_rsrc_register files;
+    memset(&files, 0, sizeof(files));
+    files.nr = slots;
+    files.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (ring.reg(IORING_REGISTER_FILES2, &files, sizeof(files)) < 0) {
+        log_error("io_uring register files failed");
+        return false;
+    }
+
+    // receive buffers: a ring of nbufs buffers of bufsize bytes, handed back after use
+    unsigned nbufs = cfg.uring_buffers, bufsize = cfg.uring_buffer_size;
+    page_block br_mem(nbufs*sizeof(io_uring_buf)), buf_mem(size_t(nbufs)*bufsize);
+    if (!br_mem.ok() || !buf_mem.ok()) {
+        log_error("io_uring buffer allocation failed");
+        return false;
+    }
+    // io_uring_buf_ring's flexible array member is misplaced in C++ (its empty struct
+    // takes space) - index the ring as plain io_uring_buf, the tail overlays bufs[0].resv
+    auto br = reinterpret_cast<io_uring_buf*>(br_mem.data());
+    uint16_t* br_tail_shared = &br[0].resv;
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = uint64_t(uintptr_t(br));
+    reg.ring_entries = nbufs;
+    reg.bgid = 0;
+    if (ring.reg(IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        log_error("io_uring register buffer ring failed");
+        return false;
+    }
+    uint16_t br_tail = 0;
+    auto recycle = [&](unsigned bid) {
+        io_uring_buf& b = br[br_tail++ & (nbufs - 1)];
+        b.addr = uint64_t(uintptr_t(buf_mem.data() + size_t(bid)*bufsize));
+        b.len = bufsize;
+        b.bid = uint16_t(bid);
+    };
+    for (unsigned bid = 0; bid < nbufs; bid++) recycle(bid);
+    __atomic_store_n(br_tail_shared, br_tail, __ATOMIC_RELEASE);
+
+    // the replies are all the same acknowledgement: a registered buffer holds it over and over,
+    // so any number of queued replies - even after a short write - is one slice of it
+    string_view ack = srv_ack(cfg.framing);
+    size_t reply_len = (64*1024/ack.size())*ack.size();
+    page_block reply(reply_len);
+    if (!reply.ok()) return false;
+    for (size_t at = 0; at < reply_len; at += ack.size()) memcpy(reply.data() + at, ack.data(), ack.size());
+    iovec reply_iov{reply.data(), reply_len};
+    if (ring.reg(IORING_REGISTER_BUFFERS, &reply_iov, 1) < 0) {
+        log_error("io_uring register buffers failed");
+        return false;
+    }
+
+    enum class recv_state : uint8_t { idle, armed, cancelling };
+    // per client slot - at most one write is in flight, so short writes cannot reorder bytes
+    struct uring_conn {
+        uint32_t gen = 0;
+        frame_parser parser;
+        size_t queued = 0;              // reply bytes not written yet
+        size_t inflight = 0;            // bytes of the write in flight
+        size_t phase = 0;               // written bytes modulo the reply size
+        recv_state recv = recv_state::idle;
+        bool closing = false;           // close once the queued replies are written
+        bool dirty = false;
+        srv_conn_timer timer;
+
+        explicit uring_conn(const srv_config& cfg) : parser(cfg.framing, cfg.max_frame) {}
+    };
+    vector<uring_conn> conns;
+    conns.reserve(slots);
+    for (unsigned i = 0; i < slots; i++) conns.emplace_back(cfg);
+    vector<uint32_t> dirty;
+    srv_metrics& m = shard.metrics;
+    bool accepting = false;
+    bool cancelling = false;
+    bool stop = false;
+    bool unsupported = false;
+    const uint64_t tick_ns = srv_tick_ns(cfg);
+    uint64_t tick = metrics_now_ns()/tick_ns;
+    timer_wheel wheel(tick);
+    // one absolute timeout at the wheel's next due tick; a re-armed earlier one leaves the
+    // old one to complete unheeded (its sequence number in the generation bits is stale)
+    __kernel_timespec timer_ts;
+    uint64_t timer_armed = 0;           // absolute ns of the current timeout, 0: none
+    uint32_t timer_seq = 0;
+
+    auto arm_timer = [&]() {
+        int64_t due = wheel.next_due();
+        if (due < 0) return;
+        uint64_t due_ns = (wheel.now() + uint64_t(due))*tick_ns;
+        if (timer_armed && timer_armed <= due_ns) return;
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (!sqe) return;
+        timer_ts.tv_sec = int64_t(due_ns/1000000000);
+        timer_ts.tv_nsec = int64_t(due_ns%1000000000);
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = uint64_t(uintptr_t(&timer_ts));
+        sqe->len = 1;
+        sqe->timeout_flags = IORING_TIMEOUT_ABS;
+        sqe->user_data = tag(op_timer, ++timer_seq, 0);
+        timer_armed = due_ns;
+    };
+    auto arm_accept = [&]() {
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = shard.srv_sock;
+        // direct descriptors are never in the process table - no SOCK_CLOEXEC
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->file_index = IORING_FILE_INDEX_ALLOC;
+        sqe->user_data = tag(op_accept, 0, 0);
+        accepting = true;
+    };
+    auto arm_recv = [&](uint32_t slot) {
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = int(slot);
+        sqe->flags = IOSQE_FIXED_FILE|IOSQE_BUFFER_SELECT;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->buf_group = 0;
+        sqe->user_data = tag(op_recv, conns[slot].gen, slot);
+        conns[slot].recv = recv_state::armed;
+    };
+    // a client with too much unwritten output is not read until it catches up
+    auto pause_recv = [&](uint32_t slot) {
+        if (conns[slot].recv != recv_state::armed) return;
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = tag(op_recv, conns[slot].gen, slot);
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        conns[slot].recv = recv_state::cancelling;
+    };
+    auto write_queued = [&](uint32_t slot) {
+        uring_conn& c = conns[slot];
+        if (c.inflight || !c.queued) return;
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (!sqe) return;
+        c.inflight = min(c.queued, reply_len - c.phase);
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->fd = int(slot);
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->addr = uint64_t(uintptr_t(reply.data() + c.phase));
+        sqe->len = unsigned(c.inflight);
+        sqe->off = uint64_t(-1);
+        sqe->buf_index = 0;
+        sqe->user_data = tag(op_send, c.gen, slot);
+    };
+    // closes that found no room for their chain in the submission ring, retried every pass
+    vector<uint32_t> close_later;
+    // cancel whatever is pending on the slot -> close it, as one linked chain
+    auto queue_close = [&](uint32_t slot) {
+        if (ring.sq_space() < 2) ring.submit(0);
+        // both entries or none - a chain split over two submits would lose the link
+        if (ring.sq_space() < 2) return false;
+        io_uring_sqe* sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = int(slot);
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD|IORING_ASYNC_CANCEL_FD_FIXED|IORING_ASYNC_CANCEL_ALL;
+        sqe->flags = IOSQE_IO_HARDLINK|IOSQE_CQE_SKIP_SUCCESS;
+        sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = slot + 1;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        // the slot is free for the next accept only once its close is on the way
+        shard.conn_count--;
+        if (!accepting && shard.conn_count < max_conn) arm_accept();
+        return true;
+    };
+    // the new generation makes the completions still due for the slot stale right away
+    auto finish_close = [&](uint32_t slot) {
+        uring_conn& c = conns[slot];
+        c.gen++;
+        c.parser.reset();
+        c.queued = c.inflight = c.phase = 0;
+        c.recv = recv_state::idle;
+        c.closing = false;
+        wheel.cancel(c.timer.node);
+        if (!queue_close(slot)) close_later.push_back(slot);
+    };
+    auto retry_closes = [&]() {
+        size_t kept = 0;
+        for (uint32_t slot : close_later) {
+            if (!queue_close(slot)) close_later[kept++] = slot;
+        }
+        close_later.resize(kept);
+    };
+    // with_ack: the last acknowledgement (and everything queued before it) is written first
+    auto close_slot = [&](uint32_t slot, bool with_ack) {
+        uring_conn& c = conns[slot];
+        if (!with_ack) {
+            finish_close(slot);
+            return;
+        }
+        c.queued += ack.size();
+        c.closing = true;
+        pause_recv(slot);
+        write_queued(slot);
+    };
+    auto cancel_accept = [&]() {
+        if (!accepting || cancelling) return;
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = tag(op_accept, 0, 0);
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        cancelling = true;
+    };
+
+    auto handle = [&](const io_uring_cqe& cqe) {
+        uint64_t op = cqe.user_data >> 56;
+        uint32_t gen = uint32_t(cqe.user_data >> 32) & 0xffffff;
+        uint32_t slot = uint32_t(cqe.user_data);
+        if (op == op_wake) {
+            stop = true;
+        } else if (op == op_timer) {
+            if (gen == (timer_seq & 0xffffff)) timer_armed = 0;
+        } else if (op == op_accept) {
+            if (cqe.res >= 0) {
+                // new connection - its direct descriptor is the slot
+                slot = uint32_t(cqe.res);
+                shard.conn_count++;
+                shard.accepted++;
+                conns[slot].timer.node.owner = slot;
+                srv_touch(cfg, wheel, conns[slot].timer, tick, false);
+                arm_recv(slot);
+                TRACE("shard " << shard.id << ": client slot " << slot);
+                // at the limit new connections wait in the listen backlog
+                if (shard.conn_count >= max_conn) cancel_accept();
+            } else if (cqe.res == -EINVAL && shard.accepted == 0) {
+                // the kernel does not know multishot accept into direct descriptors
+                unsupported = stop = true;
+                return;
+            } else if (cqe.res != -ECANCELED) {
+                errno = -cqe.res;
+                log_error("multishot accept failed");
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                // the accept ended - cancelled at the limit, or on an error
+                accepting = cancelling = false;
+                if (shard.conn_count < max_conn) arm_accept();
+            }
+        } else if (op == op_recv) {
+            uring_conn& c = conns[slot];
+            bool stale = gen != (c.gen & 0xffffff);
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                if (!stale && !c.closing && cqe.res > 0) {
+                    bool timed = (++m.sample_tick & 63) == 0;
+                    uint64_t read_done = timed ? metrics_now_ns() : 0;
+                    m.bytes_in.add(uint64_t(cqe.res));
+                    // frames are parsed in place in the provided buffer
+                    const char* msg = buf_mem.data() + size_t(bid)*bufsize;
+                    frame_action last = frame_action::ack;
+                    uint64_t frames = 0;
+                    bool keep = c.parser.feed(msg, size_t(cqe.res), [&](const frame& f) {
+                        frames++;
+                        last = srv_handle_frame(f);
+                        if (last == frame_action::ack) c.queued += ack.size();
+                        return last == frame_action::ack;
+                    });
+                    m.messages.add(frames);
+                    if (timed) m.handle_ns.record(metrics_now_ns() - read_done);
+                    srv_touch(cfg, wheel, c.timer, tick, c.parser.buffered() > 0);
+                    if (!keep) {
+                        bool malformed = c.parser.failed();
+                        if (malformed) {
+                            ERROR("malformed frame - closing the client");
+                            m.errors.add();
                         }
-                        INFO(buffer);
+                        close_slot(slot, !malformed && last == frame_action::ack_close);
+                    } else if (c.queued && !c.dirty) {
+                        c.dirty = true;
+                        dirty.push_back(slot);
                     }
-                } else if (events[event].events & EPOLLHUP || events[event].events & EPOLLERR) {
-                    // a disconnect hit detected - disconnect current client
-                    INFO("client disconnect");
-                    struct epoll_event ev;
-                    memcpy(&ev, &events[event], sizeof(epoll_event));
-                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, events[event].data.fd, &ev);
-                    close(events[event].data.fd);
-                    conn_count--;
                 }
+                recycle(bid);
             }
-        } else {
-            INFO("epoll_wait - time out [no new events]");
+            if (stale || gen != (c.gen & 0xffffff)) return;
+            bool more = cqe.flags & IORING_CQE_F_MORE;
+            if (!more) c.recv = recv_state::idle;
+            if (cqe.res == -ENOBUFS) m.eagain.add();
+            if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)) {
+                if (cqe.res == 0) {
+                    // orderly shutdown from the client
+                    TRACE("client disconnect");
+                } else {
+                    errno = -cqe.res;
+                    log_error("client recv failed");
+                    m.errors.add();
+                }
+                finish_close(slot);
+            } else if (!more && !c.closing && c.queued < cfg.out_high_water) {
+                // out of buffers (recycled by now), or the kernel ended the multishot
+                arm_recv(slot);
+            }
+        } else if (op == op_send) {
+            uring_conn& c = conns[slot];
+            if (gen != (c.gen & 0xffffff)) return;
+            if (cqe.res < 0) {
+                errno = -cqe.res;
+                log_error("client write failed");
+                m.errors.add();
+                finish_close(slot);
+                return;
+            }
+            m.bytes_out.add(uint64_t(cqe.res));
+            c.queued -= size_t(cqe.res);
+            c.phase = (c.phase + size_t(cqe.res)) % ack.size();
+            c.inflight = 0;
+            srv_touch(cfg, wheel, c.timer, tick, c.parser.buffered() > 0);
+            if (c.queued) {
+                write_queued(slot);
+            } else if (c.closing) {
+                finish_close(slot);
+                return;
+            }
+            if (!c.closing && c.recv == recv_state::idle && c.queued < cfg.out_high_water) arm_recv(slot);
+        }
+    };
+    // the replies of this pass go out as one write per client
+    auto flush_dirty = [&]() {
+        for (uint32_t slot : dirty) {
+            uring_conn& c = conns[slot];
+            c.dirty = false;
+            if (c.closing || !c.queued) continue;
+            write_queued(slot);
+            if (c.queued >= cfg.out_high_water) pause_recv(slot);
         }
+        dirty.clear();
+    };
+
+    // the wake eventfd stays a normal descriptor, polled once
+    io_uring_sqe* sqe = ring.get_sqe();
+    if (!sqe) {
+        log_error("io_uring submission ring full");
+        return false;
     }
-    INFO("server socket shutdown");
-    shutdown(srv_sock, SHUT_RDWR);
-    close(srv_sock);
-    INFO("server thread terminated.");
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = shard.wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = tag(op_wake, 0, 0);
+    arm_accept();
+
+    while (srv_run && !stop) {
+        __atomic_store_n(br_tail_shared, br_tail, __ATOMIC_RELEASE);
+        if (ring.submit(1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            log_error("io_uring_enter failed");
+            break;
+        }
+        uint64_t pass_start = metrics_now_ns();
+        tick = pass_start/tick_ns;
+        unsigned completions = ring.for_each_cqe(handle);
+        flush_dirty();
+        if (!close_later.empty()) retry_closes();
+        uint64_t pass_end = metrics_now_ns();
+        // clients that went quiet, even one still writing its last acknowledgement
+        wheel.advance(pass_end/tick_ns, [&](timer_node& node) {
+            auto slot = uint32_t(node.owner);
+            TRACE("shard " << shard.id << ": " << srv_timeout_reason(conns[slot].timer, wheel) << " - closing client slot " << slot);
+            m.timeouts.add();
+            finish_close(slot);
+        });
+        arm_timer();
+        m.wakeups.add();
+        m.batch.record(completions);
+        m.loop_ns.record(pass_end - pass_start);
+    }
+    // closing the ring cancels the requests and closes the direct descriptors
+    INFO("shard " << shard.id << " io_uring reactor done");
+    return !unsupported;
 }
 
-void cli_thread(const char *psrv_addr, int srv_port) {
-    INFO("client thread started.");
-    sockaddr_storage srv_sockaddr;
-    socklen_t srv_sockaddr_size = sizeof(sockaddr_storage);
-    
-    int family = AF_INET6;
-    int cli_sock = socket(AF_INET6, SOCK_STREAM, 0);
+/**
+ * Reactor thread of a shard on its backend
+ */
+void srv_thread(const srv_config& cfg, srv_shard& shard) {
+    if (cfg.pin_cores) pin_to_core(shard.id);
+    if (shard.uring && !srv_uring_thread(cfg, shard)) {
+        ERROR("shard " << shard.id << " falls back onto epoll");
+        shard.uring = false;
+    }
+#ifdef __cpp_impl_coroutine
+    if (!shard.uring && cfg.coro_sessions) srv_coro_thread(cfg, shard);
+#endif
+    if (!shard.uring && !cfg.coro_sessions) srv_epoll_thread(cfg, shard);
+    INFO("shard " << shard.id << " server socket shutdown");
+    shutdown(shard.srv_sock, SHUT_RDWR);
+    close(shard.srv_sock);
+    close(shard.wake_fd);
+    INFO("shard " << shard.id << " server thread terminated.");
+}
 
-    if (cli_sock < 0) {
-        // capture the error message which led to socket call to fail
-        // it could be a number of reasons. Let's investigate first
-        log_error("socket call with PF_INET6 failed.");
-        cli_sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (cli_sock < 0)
-        {
-            log_error("socket call with PF_INET failed");
-            cerr << "Give up and exit." << endl;
-            exit (EXIT_FAILURE);
+/**
+ * Bind every shard's listening socket, then start the reactors. The sockets are all
+ * listening before this returns, so clients may connect right away.
+ */
+vector<unique_ptr<srv_shard>> srv_start(const srv_config& cfg) {
+    // every client needs a descriptor, plus a few per shard for the listener and epoll
+    raise_fd_limit(rlim_t(cfg.shards)*(cfg.max_conn_per_shard + 4) + 64);
+    bool uring = false;
+    if (cfg.backend != srv_backend::epoll && !cfg.coro_sessions) {
+        uring = uring_supported();
+        if (!uring && cfg.backend == srv_backend::uring) {
+            ERROR("io_uring with provided buffer rings is not available - using epoll");
         }
-        // Confirm running Address family IPv4
-        family = AF_INET6;
-        // adjust the socket address structure match sockaddr_in
-        srv_sockaddr_size = sizeof(struct sockaddr_in);
-        auto psa = reinterpret_cast<sockaddr_in*>(&srv_sockaddr);
-        psa->sin_family = AF_INET;
-        psa->sin_addr.s_addr = htonl(INADDR_ANY);
-        psa->sin_port = htons(srv_port);
-    } else {
-        // Confirm running address family IPv6
-        family = AF_INET6;
-        // adjust the socket address structure match sockaddr_in6
-        srv_sockaddr_size = sizeof(struct sockaddr_in6);
-        auto psa6 = reinterpret_cast<sockaddr_in6*>(&srv_sockaddr);
-        psa6->sin6_family = AF_INET6;
-        psa6->sin6_addr = in6addr_any;
-        psa6->sin6_port = htons(srv_port);
-        srv_sockaddr_size = sizeof(sockaddr_in6);
     }
+    INFO("server backend: " << (uring ? "io_uring" : cfg.coro_sessions ? "epoll, coroutine sessions" : "epoll"));
+    shared_ptr<srv_sorter> sorter;
+    if (cfg.sort_service) {
+        sorter = make_shared<srv_sorter>(cfg);
+        INFO("sort service: " << sorter->pool.size() << " workers, " << (cfg.sort_memory >> 20) <<
+             " MiB in memory, spilling to " << cfg.sort.temp_dir);
+    }
+    vector<unique_ptr<srv_shard>> shards;
+    for (unsigned i = 0; i < cfg.shards; i++) {
+        shards.push_back(make_unique<srv_shard>());
+        shards.back()->id = i;
+        shards.back()->uring = uring;
+        shards.back()->sorter = sorter;
+        shards.back()->srv_sock = srv_listen_socket(cfg.port, cfg.backlog);
+        shards.back()->wake_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (shards.back()->wake_fd < 0) {
+            log_error("eventfd failed");
+            exit(1);
+        }
+    }
+    for (auto& shard : shards) {
+        shard->thx = thread{srv_thread, cref(cfg), ref(*shard)};
+    }
+    return shards;
+}
 
-    addrinfo hints;
-    addrinfo *result, *rp;
-    int sfd, s;
-    size_t len;
-    ssize_t nread;
-    char buf[256];
-    /* Obtain address(es) matching host/port. */
-
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET6;    /* Allow IPv4 or IPv6 */
-    hints.ai_socktype = SOCK_STREAM; /* Datagram socket */
-    hints.ai_flags = 0;
-    hints.ai_protocol = 0;          /* Any protocol */
-
-    char num_char[5 + sizeof(char)];
-    to_chars(num_char, &num_char[5], srv_port);
-    s = getaddrinfo(psrv_addr, num_char, &hints, &result);
-    if (s != 0) {
-        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(s));
-        exit(EXIT_FAILURE);
-    }
-   
-    /* getaddrinfo() returns a list of address structures.
-        Try each address until we successfully connect(2).
-        If socket(2) (or connect(2)) fails, we (close the socket
-        and) try the next address. */
-
-    for (rp = result; rp != NULL; rp = rp->ai_next) {
-        cli_sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (cli_sock == -1)
-            continue;
-        if (connect(cli_sock, rp->ai_addr, rp->ai_addrlen) != -1)
-            break;                  /* Success */
-        close(cli_sock);
-    }
-    freeaddrinfo(result);       
-    char msg_buf[256];
-    memset(msg_buf, 0, 256);
-    write(cli_sock, "[buybuy]", 8);
-    int rb = read(cli_sock, msg_buf, 255);
-    INFO(msg_buf);
-    shutdown(cli_sock, SHUT_RDWR);
-    close(cli_sock);
+/**
+ * Stop and join the reactors - the eventfd wakes a reactor blocked in epoll_wait or io_uring_enter
+ */
+void srv_stop(vector<unique_ptr<srv_shard>>& shards) {
+    srv_run = false;
+    for (auto& shard : shards) {
+        uint64_t one = 1;
+        if (write(shard->wake_fd, &one, sizeof(one)) < 0) log_error("eventfd write failed");
+    }
+    for (auto& shard : shards) {
+        if (shard->thx.joinable()) shard->thx.join();
+        INFO("shard " << shard->id << " accepted " << shard->accepted << " connections");
+    }
+}
+
+/**
+ * The metrics of every shard in the Prometheus text format - counters per shard,
+ * histograms merged over the shards
+ */
+string srv_metrics_text(const vector<unique_ptr<srv_shard>>& shards) {
+    metrics_text out;
+    auto per_shard = [&](const char* name, const char* type, const char* help, auto value) {
+        out.family(name, type, help);
+        for (auto& shard : shards) {
+            out.sample(name, "shard=\"" + to_string(shard->id) + "\"", double(value(*shard)));
+        }
+    };
+    per_shard("network6_accepts_total", "counter", "Connections accepted.",
+              [](const srv_shard& s) { return s.accepted.load(memory_order_relaxed); });
+    per_shard("network6_connections", "gauge", "Open client connections.",
+              [](const srv_shard& s) { return s.conn_count.load(memory_order_relaxed); });
+    per_shard("network6_received_bytes_total", "counter", "Bytes read from clients.",
+              [](const srv_shard& s) { return s.metrics.bytes_in.value(); });
+    per_shard("network6_sent_bytes_total", "counter", "Bytes written to clients.",
+              [](const srv_shard& s) { return s.metrics.bytes_out.value(); });
+    per_shard("network6_messages_total", "counter", "Client frames handled.",
+              [](const srv_shard& s) { return s.metrics.messages.value(); });
+    per_shard("network6_eagain_total", "counter", "Reads and writes that found the socket not ready.",
+              [](const srv_shard& s) { return s.metrics.eagain.value(); });
+    per_shard("network6_errors_total", "counter", "Clients dropped on an error.",
+              [](const srv_shard& s) { return s.metrics.errors.value(); });
+    per_shard("network6_wakeups_total", "counter", "Reactor passes (epoll_wait or io_uring_enter returns).",
+              [](const srv_shard& s) { return s.metrics.wakeups.value(); });
+    per_shard("network6_timeouts_total", "counter", "Clients closed on an idle or read timeout.",
+              [](const srv_shard& s) { return s.metrics.timeouts.value(); });
+    per_shard("network6_sort_jobs_total", "counter", "Sorts returned completely.",
+              [](const srv_shard& s) { return s.metrics.sort_jobs.value(); });
+    per_shard("network6_sort_records_total", "counter", "Records of the sorts returned.",
+              [](const srv_shard& s) { return s.metrics.sort_records.value(); });
+    per_shard("network6_sort_spills_total", "counter", "Sorted runs spilled to disk.",
+              [](const srv_shard& s) { return s.metrics.sort_spills.value(); });
+
+    hdr_histogram loop_ns, batch, handle_ns;
+    for (auto& shard : shards) {
+        loop_ns.merge(shard->metrics.loop_ns);
+        batch.merge(shard->metrics.batch);
+        handle_ns.merge(shard->metrics.handle_ns);
+    }
+    const vector<double> seconds = {1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+                                    1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1};
+    out.histogram("network6_loop_seconds", "Duration of a reactor pass.", loop_ns, seconds, 1e-9);
+    out.histogram("network6_batch_events", "Events (completions) handled by a reactor pass.", batch,
+                  {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 4096}, 1);
+    out.histogram("network6_message_seconds", "Received bytes to their replies queued, sampled every 64th read.",
+                  handle_ns, seconds, 1e-9);
+    return out.str();
+}
+
+/**
+ * A client session through the shared pool: requests data frames sent back to back,
+ * then their acks. The connection goes back to the pool for the next session - the
+ * pool closes it when the program ends.
+ */
+void cli_thread(client_pool& pool, const string& srv_addr, int srv_port, unsigned id, int requests) {
+    INFO("client thread started.");
+    int err = 0;
+    unique_ptr<client_conn> conn = pool.acquire(srv_addr, srv_port, &err);
+    if (!conn) {
+        errno = err;
+        log_error("connect to " + srv_addr + " failed");
+        return;
+    }
+    for (int i = 0; i < requests; i++) {
+        conn->send(frame_op::data, "client " + to_string(id) + " request " + to_string(i));
+    }
+    int acks = 0;
+    while (acks < requests) {
+        const frame* f = conn->receive(cli_conn_timeout);
+        if (!f) {
+            log_error("client " + to_string(id) + " receive failed");
+            break;
+        }
+        if (f->op == frame_op::ack || f->payload == "ACK") acks++;
+    }
+    INFO(acks << " of " << requests << " ACK");
+    pool.release(move(conn));
     INFO("client thread terminated.");
 }
 
+/**
+ * usage: network6 [--port=5000] [--shards=N] [--max-conn=per shard] [--clients=5] [--requests=4] [--host=localhost]
+ *                 [--backend=auto|epoll|uring] [--framing=length|line] [--no-pin]
+ *                 [--log-level=trace|info|warn|error|off] [--stats=path]
+ *                 [--idle-timeout=ms] [--read-timeout=ms] [--timerfd] [--handler=inline|coro]
+ *                 [--service=ack|sort] [--sort-workers=N] [--sort-memory=MiB] [--sort-run=records]
+ *                 [--sort-dir=path]
+ * with --clients=0 the server runs until SIGINT/SIGTERM, else every client pipelines --requests
+ * requests over a pooled keep-alive connection (net_client.hxx)
+ * --stats serves the metrics on a UNIX socket: curl --unix-socket path http://localhost/metrics
+ * a timeout of 0 disables it; --timerfd wakes the epoll reactor for timeouts on a timerfd
+ * --handler=coro runs a coroutine per client on epoll, in builds with -std=c++20
+ * --service=sort sorts the records clients send (net_sort.hxx), on coroutine sessions
+ */
 int main(int argc,const char **argv) {
+    srv_config cfg;
+    int max_cli_thx = 5;
+    int cli_requests = 4;
+    string srv_addr = "localhost";
+    string stats_path;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq);
+        int value = eq == string::npos ? 0 : atoi(arg.c_str() + eq + 1);
+        if (key == "--port") {
+            cfg.port = value;
+        } else if (key == "--shards" && value > 0) {
+            cfg.shards = unsigned(value);
+        } else if (key == "--max-conn" && value > 0) {
+            cfg.max_conn_per_shard = value;
+        } else if (key == "--clients") {
+            max_cli_thx = value;
+        } else if (key == "--requests" && value > 0) {
+            cli_requests = value;
+        } else if (key == "--host" && eq != string::npos) {
+            srv_addr = arg.substr(eq + 1);
+        } else if (key == "--backend" && eq != string::npos) {
+            string name = arg.substr(eq + 1);
+            cfg.backend = name == "epoll" ? srv_backend::epoll :
+                          name == "uring" ? srv_backend::uring : srv_backend::automatic;
+        } else if (key == "--framing" && eq != string::npos) {
+            cfg.framing = arg.substr(eq + 1) == "line" ? frame_mode::delimited : frame_mode::length_prefixed;
+        } else if (key == "--no-pin") {
+            cfg.pin_cores = false;
+        } else if (key == "--stats" && eq != string::npos) {
+            stats_path = arg.substr(eq + 1);
+        } else if (key == "--idle-timeout" && value >= 0) {
+            cfg.idle_timeout_ms = value;
+        } else if (key == "--read-timeout" && value >= 0) {
+            cfg.read_timeout_ms = value;
+        } else if (key == "--timerfd") {
+            cfg.timer_fd = true;
+        } else if (key == "--handler" && eq != string::npos) {
+            cfg.coro_sessions = arg.substr(eq + 1) == "coro";
+#ifndef __cpp_impl_coroutine
+            if (cfg.coro_sessions) {
+                ERROR("built without C++20 coroutines - the inline handler is used");
+                cfg.coro_sessions = false;
+            }
+#endif
+        } else if (key == "--service" && eq != string::npos) {
+            cfg.sort_service = arg.substr(eq + 1) == "sort";
+        } else if (key == "--sort-workers" && value > 0) {
+            cfg.sort_workers = unsigned(value);
+        } else if (key == "--sort-memory" && value >= 0) {
+            cfg.sort_memory = size_t(value) << 20;
+        } else if (key == "--sort-run" && value > 0) {
+            cfg.sort.run_records = size_t(value);
+        } else if (key == "--sort-dir" && eq != string::npos) {
+            cfg.sort.temp_dir = arg.substr(eq + 1);
+        } else if (key == "--log-level" && eq != string::npos) {
+            string name = arg.substr(eq + 1);
+            log_set_level(name == "trace" ? log_level::trace : name == "warn" ? log_level::warn :
+                          name == "error" ? log_level::error : name == "off" ? log_level::off : log_level::info);
+        } else {
+            cerr << "usage: " << argv[0] << " [--port=5000] [--shards=N] [--max-conn=N] [--clients=N] [--requests=N]"
+                 " [--host=name]"
+                 " [--backend=auto|epoll|uring] [--framing=length|line] [--no-pin]"
+                 " [--log-level=trace|info|warn|error|off] [--stats=path]"
+                 " [--idle-timeout=ms] [--read-timeout=ms] [--timerfd] [--handler=inline|coro]"
+                 " [--service=ack|sort] [--sort-workers=N] [--sort-memory=MiB] [--sort-run=records]"
+                 " [--sort-dir=path]" << endl;
+            return 1;
+        }
+    }
+    if (cfg.sort_service) {
+#ifdef __cpp_impl_coroutine
+        // the sessions wait for the sorting pool - only a coroutine session can
+        cfg.coro_sessions = true;
+#else
+        ERROR("the sort service runs on coroutine sessions, built without C++20 - the ack service is used");
+        cfg.sort_service = false;
+#endif
+    }
+
+    // without clients the server runs until it is told to stop - e.g. under net_load
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    if (max_cli_thx == 0) pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
 
-    thread srv_thx{srv_thread, 5000};
-    char srv_addr[] = "localhost";
+    auto shards = srv_start(cfg);
+    metrics_endpoint stats;
+    if (!stats_path.empty()) {
+        if (stats.start(stats_path, [&shards] { return srv_metrics_text(shards); })) {
+            INFO("metrics on unix socket " << stats_path);
+        } else {
+            log_error("metrics socket " + stats_path + " failed");
+        }
+    }
+    client_options cli_opt;
+    cli_opt.framing = cfg.framing;
+    client_pool cli_pool(cli_opt);
     vector<thread> v_cli;
-    const int max_cli_thx = 5;
     for (int i = 0; i < max_cli_thx; i++) {
-        v_cli.emplace_back(thread{cli_thread, srv_addr, 5000});
+        v_cli.emplace_back(thread{cli_thread, ref(cli_pool), cref(srv_addr), cfg.port, unsigned(i), cli_requests});
     }
 
     for_each(v_cli.begin(), v_cli.end(), [&](thread& tx){
@@ -295,9 +1724,19 @@ int main(int argc,const char **argv) {
             tx.join();
     });
 
-    srv_run = false;
+    if (max_cli_thx == 0) {
+        int sig;
+        sigwait(&stop_signals, &sig);
+        INFO("signal " << sig << " - stopping the server");
+    }
 
-    srv_thx.join();
+    if (max_cli_thx > 0) {
+        INFO("client pool: " << cli_pool.connects() << " connects, " << cli_pool.reused() << " reused, " <<
+             cli_pool.resolver().misses() << " lookups");
+    }
+    cli_pool.clear();
+    stats.stop();
+    srv_stop(shards);
     INFO("main terminated.");
     return 0;
 }
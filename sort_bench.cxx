@@ -0,0 +1,448 @@
+/**
+ * @file sort_bench.cxx
+ * @author Alex H Levi (alex.h.levi.il@gmail.com)
+ * @brief Benchmark of the merge sort family against std::sort and std::stable_sort
+ *      over input sizes, key distributions and element types. Reports elements/s,
+ *      comparisons, heap allocations and (where perf_event_open is permitted)
+ *      cycles, cache misses and branch mispredicts as JSON.
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright Alex Levi Software Consulting Copyright (c) 2021
+ *
+ * usage: sort_bench [--sizes=10,1000,...] [--types=int32,int64,double,rec16,rec64,string]
+ *                   [--dists=uniform,sorted,reverse,organ_pipe,few_unique,nearly_sorted,zipf]
+ *                   [--algos=merge,parallel,adaptive,stable,indirect,std_sort,std_stable_sort]
+ *                   [--reps=3] [--threads=N] [--tag=label] [--json=results.json] [--no-counts]
+ */
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "merge_sort.hxx"
+
+using namespace std;
+
+// every heap allocation of the process goes through here and is counted
+static atomic<uint64_t> alloc_count{0};
+static atomic<uint64_t> alloc_bytes{0};
+
+void* operator new(size_t size) {
+    alloc_count.fetch_add(1, memory_order_relaxed);
+    alloc_bytes.fetch_add(size, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+// out of line, so callers never see the free() pairing with an operator new
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+// comparisons made through Counted<T> elements
+static atomic<uint64_t> compare_count{0};
+
+/**
+ * @brief Element wrapper counting every comparison made by a sort
+ */
+template<typename T>
+struct Counted {
+    T v;
+    bool operator<=(const Counted& o) const {
+        compare_count.fetch_add(1, memory_order_relaxed);
+        return v <= o.v;
+    }
+    bool operator<(const Counted& o) const {
+        compare_count.fetch_add(1, memory_order_relaxed);
+        return v < o.v;
+    }
+};
+
+/**
+ * @brief 16 byte record: key plus one word of payload
+ */
+struct Rec16 {
+    int64_t key;
+    int64_t payload;
+    bool operator<=(const Rec16& o) const { return key <= o.key; }
+    bool operator<(const Rec16& o) const { return key < o.key; }
+};
+
+/**
+ * @brief 64 byte record: key plus a cache line worth of payload
+ */
+struct Rec64 {
+    int64_t key;
+    char payload[56];
+    bool operator<=(const Rec64& o) const { return key <= o.key; }
+    bool operator<(const Rec64& o) const { return key < o.key; }
+};
+
+template<typename T> T makeElement(uint64_t k);
+template<> int32_t makeElement<int32_t>(uint64_t k) { return int32_t(k); }
+template<> int64_t makeElement<int64_t>(uint64_t k) { return int64_t(k); }
+template<> double makeElement<double>(uint64_t k) { return double(k); }
+template<> Rec16 makeElement<Rec16>(uint64_t k) { return Rec16{int64_t(k), int64_t(~k)}; }
+template<> Rec64 makeElement<Rec64>(uint64_t k) {
+    Rec64 r;
+    r.key = int64_t(k);
+    memset(r.payload, int(k & 0xff), sizeof(r.payload));
+    return r;
+}
+template<> string makeElement<string>(uint64_t k) {
+    // zero padded, so string order is the numeric order; 10 chars stay in the SSO buffer
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%010llu", static_cast<unsigned long long>(k % 10000000000ULL));
+    return string(buf);
+}
+
+// projection used by the stableSort() runs: records are sorted by their key field
+template<typename T> auto keyOf() { return Identity(); }
+template<> auto keyOf<Rec16>() { return &Rec16::key; }
+template<> auto keyOf<Rec64>() { return &Rec64::key; }
+
+/**
+ * @brief Keys (all below 2^31) of one of the benchmark distributions
+ */
+vector<uint64_t> makeKeys(const string& dist, size_t n, mt19937_64& rnd) {
+    constexpr uint64_t key_range = uint64_t(1) << 31;
+    vector<uint64_t> keys(n);
+    if (dist == "uniform") {
+        for (auto& k : keys) k = rnd() % key_range;
+    } else if (dist == "sorted") {
+        for (size_t i = 0; i < n; i++) keys[i] = i;
+    } else if (dist == "reverse") {
+        for (size_t i = 0; i < n; i++) keys[i] = n - 1 - i;
+    } else if (dist == "organ_pipe") {
+        for (size_t i = 0; i < n; i++) keys[i] = i < n/2 ? i : n - 1 - i;
+    } else if (dist == "few_unique") {
+        for (auto& k : keys) k = rnd() % 16;
+    } else if (dist == "nearly_sorted") {
+        // sorted with 1% of the elements swapped to random places
+        for (size_t i = 0; i < n; i++) keys[i] = i;
+        for (size_t s = 0; s < n/100 + 1; s++) swap(keys[rnd() % n], keys[rnd() % n]);
+    } else if (dist == "zipf") {
+        // exponent 1 over up to 2^20 ranks, sampled by inverting the CDF
+        size_t ranks = min<size_t>(max<size_t>(n, 1), size_t(1) << 20);
+        vector<double> cdf(ranks);
+        double sum = 0;
+        for (size_t r = 0; r < ranks; r++) cdf[r] = (sum += 1.0/double(r + 1));
+        uniform_real_distribution<double> u(0, sum);
+        for (auto& k : keys) {
+            uint64_t rank = lower_bound(cdf.begin(), cdf.end(), u(rnd)) - cdf.begin();
+            // scatter the ranks over the key space
+            k = (rank * 0x9E3779B97F4A7C15ULL >> 17) % key_range;
+        }
+    } else {
+        throw invalid_argument("unknown distribution " + dist);
+    }
+    return keys;
+}
+
+/**
+ * @brief Hardware counters of the calling thread: cycles, cache misses, branch misses \
+ *      perf_event_open is often not permitted in containers - the counters then \
+ *      report as unavailable and the JSON carries nulls.
+ */
+class PerfCounters {
+public:
+    PerfCounters() {
+        const uint64_t configs[counter_count] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (int i = 0; i < counter_count; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            if (fds[i] < 0) available = false;
+        }
+    }
+    ~PerfCounters() {
+        for (int fd : fds) if (fd >= 0) close(fd);
+    }
+
+    void start() {
+        if (!available) return;
+        for (int fd : fds) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void stop() {
+        if (!available) return;
+        for (int i = 0; i < counter_count; i++) {
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fds[i], &values[i], sizeof(values[i])) != sizeof(values[i])) values[i] = 0;
+        }
+    }
+
+    static constexpr int counter_count = 3;
+    bool available = true;
+    uint64_t values[counter_count] = {0, 0, 0};
+
+private:
+    int fds[counter_count] = {-1, -1, -1};
+};
+
+/**
+ * @brief One line of the report
+ */
+struct BenchResult {
+    string type, dist, algo;
+    size_t size = 0;
+    size_t batch = 0;            // sorts per timed repetition
+    double seconds = 0;          // best time of one sort
+    double comparisons = -1;     // per sort, -1 when not measured
+    double allocations = 0;      // per sort
+    double alloc_bytes = 0;      // per sort
+    bool perf = false;
+    double cycles = 0, cache_misses = 0, branch_misses = 0; // per sort
+};
+
+struct BenchConfig {
+    vector<size_t> sizes{10, 100, 1000, 10000, 100000, 1000000, 10000000};
+    vector<string> types{"int32", "int64", "double", "rec16", "rec64", "string"};
+    vector<string> dists{"uniform", "sorted", "reverse", "organ_pipe", "few_unique", "nearly_sorted", "zipf"};
+    vector<string> algos{"merge", "parallel", "adaptive", "stable", "indirect", "std_sort", "std_stable_sort"};
+    int reps = 3;
+    unsigned threads = thread::hardware_concurrency();
+    string tag = "";
+    string json_path = "";
+    bool counts = true;
+    // elements sorted per timed repetition - small inputs are sorted in batches
+    size_t batch_elements = size_t(1) << 20;
+};
+
+/**
+ * @brief Run one algorithm over a vector of elements
+ * @return false for an unknown algorithm name
+ */
+template<typename T, typename Proj>
+bool runSort(const string& algo, vector<T>& v, TaskPool& pool, Proj proj) {
+    if (algo == "merge") {
+        mergeSort(v.data(), 0, v.size());
+    } else if (algo == "parallel") {
+        parallelMergeSort(pool, v.data(), 0, v.size());
+    } else if (algo == "adaptive") {
+        adaptiveMergeSort(v.data(), 0, v.size());
+    } else if (algo == "stable") {
+        stableSort(v, less<>(), proj);
+    } else if (algo == "indirect") {
+        indirectSort(v, less<>(), proj);
+    } else if (algo == "std_sort") {
+        sort(v.begin(), v.end());
+    } else if (algo == "std_stable_sort") {
+        stable_sort(v.begin(), v.end());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+template<typename T>
+BenchResult benchOne(const BenchConfig& cfg, const string& type, const string& dist, const string& algo,
+                     const vector<uint64_t>& keys, TaskPool& pool, PerfCounters& perf) {
+    BenchResult res;
+    res.type = type;
+    res.dist = dist;
+    res.algo = algo;
+    res.size = keys.size();
+    size_t n = keys.size();
+
+    vector<T> input(n);
+    for (size_t i = 0; i < n; i++) input[i] = makeElement<T>(keys[i]);
+
+    // enough copies of a small input to make the timed region measurable
+    res.batch = max<size_t>(1, min<size_t>(cfg.batch_elements/max<size_t>(n, 1), 100000));
+    vector<vector<T>> work(res.batch);
+    double best = 1e300;
+    for (int rep = 0; rep < cfg.reps; rep++) {
+        for (auto& w : work) w = input;
+        uint64_t allocs = alloc_count.load(), bytes = alloc_bytes.load();
+        perf.start();
+        auto t0 = chrono::steady_clock::now();
+        for (auto& w : work) {
+            if (!runSort(algo, w, pool, keyOf<T>())) throw invalid_argument("unknown algorithm " + algo);
+        }
+        auto t1 = chrono::steady_clock::now();
+        perf.stop();
+        double secs = chrono::duration<double>(t1 - t0).count()/res.batch;
+        if (secs < best) {
+            best = secs;
+            res.allocations = double(alloc_count.load() - allocs)/res.batch;
+            res.alloc_bytes = double(alloc_bytes.load() - bytes)/res.batch;
+            res.perf = perf.available;
+            res.cycles = double(perf.values[0])/res.batch;
+            res.cache_misses = double(perf.values[1])/res.batch;
+            res.branch_misses = double(perf.values[2])/res.batch;
+        }
+        for (auto& w : work) {
+            if (!is_sorted(w.begin(), w.end())) throw logic_error(algo + " left " + type + "/" + dist + " unsorted");
+        }
+    }
+    res.seconds = best;
+
+    // a separate untimed run on counting wrappers; radix sorted keys make no comparisons
+    using K = decay_t<invoke_result_t<decltype(keyOf<T>()), T&>>;
+    if ((algo == "stable" || algo == "indirect") && isRadixKey<K>) {
+        res.comparisons = 0;
+    } else if (cfg.counts) {
+        vector<Counted<T>> counted(n);
+        for (size_t i = 0; i < n; i++) counted[i].v = input[i];
+        compare_count = 0;
+        runSort(algo, counted, pool, Identity());
+        res.comparisons = double(compare_count.load());
+    }
+    return res;
+}
+
+BenchResult benchType(const BenchConfig& cfg, const string& type, const string& dist, const string& algo,
+                      const vector<uint64_t>& keys, TaskPool& pool, PerfCounters& perf) {
+    if (type == "int32") return benchOne<int32_t>(cfg, type, dist, algo, keys, pool, perf);
+    if (type == "int64") return benchOne<int64_t>(cfg, type, dist, algo, keys, pool, perf);
+    if (type == "double") return benchOne<double>(cfg, type, dist, algo, keys, pool, perf);
+    if (type == "rec16") return benchOne<Rec16>(cfg, type, dist, algo, keys, pool, perf);
+    if (type == "rec64") return benchOne<Rec64>(cfg, type, dist, algo, keys, pool, perf);
+    if (type == "string") return benchOne<string>(cfg, type, dist, algo, keys, pool, perf);
+    throw invalid_argument("unknown element type " + type);
+}
+
+string jsonEscape(const string& s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+void writeJson(ostream& os, const BenchConfig& cfg, const vector<BenchResult>& results, bool perf_available) {
+    os << "{\n  \"tag\": \"" << jsonEscape(cfg.tag) << "\",\n"
+       << "  \"compiler\": \"" << jsonEscape(__VERSION__) << "\",\n"
+       << "  \"threads\": " << cfg.threads << ",\n"
+       << "  \"perf_counters\": " << (perf_available ? "true" : "false") << ",\n"
+       << "  \"results\": [\n";
+    os << setprecision(10);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        auto perf_value = [&](double v) {
+            ostringstream s;
+            if (r.perf) s << setprecision(10) << v; else s << "null";
+            return s.str();
+        };
+        os << "    {\"type\": \"" << r.type << "\", \"dist\": \"" << r.dist << "\", \"algo\": \"" << r.algo
+           << "\", \"size\": " << r.size << ", \"batch\": " << r.batch
+           << ", \"seconds\": " << r.seconds
+           << ", \"elements_per_sec\": " << (r.seconds > 0 ? r.size/r.seconds : 0)
+           << ", \"comparisons\": ";
+        if (r.comparisons < 0) os << "null"; else os << r.comparisons;
+        os << ", \"allocations\": " << r.allocations << ", \"alloc_bytes\": " << r.alloc_bytes
+           << ", \"cycles\": " << perf_value(r.cycles)
+           << ", \"cache_misses\": " << perf_value(r.cache_misses)
+           << ", \"branch_misses\": " << perf_value(r.branch_misses) << "}"
+           << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+vector<string> splitList(const string& s) {
+    vector<string> out;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) if (!item.empty()) out.push_back(item);
+    return out;
+}
+
+BenchConfig parseArgs(int argc, char** argv) {
+    BenchConfig cfg;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        auto eq = arg.find('=');
+        string key = arg.substr(0, eq), value = eq == string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--sizes") {
+            cfg.sizes.clear();
+            // accepts 1e6 style sizes as well
+            for (auto& s : splitList(value)) cfg.sizes.push_back(size_t(stod(s)));
+        } else if (key == "--types") {
+            cfg.types = splitList(value);
+        } else if (key == "--dists") {
+            cfg.dists = splitList(value);
+        } else if (key == "--algos") {
+            cfg.algos = splitList(value);
+        } else if (key == "--reps") {
+            cfg.reps = max(1, stoi(value));
+        } else if (key == "--threads") {
+            cfg.threads = max(1, stoi(value));
+        } else if (key == "--tag") {
+            cfg.tag = value;
+        } else if (key == "--json") {
+            cfg.json_path = value;
+        } else if (key == "--no-counts") {
+            cfg.counts = false;
+        } else {
+            cerr << "unknown option " << arg << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    return cfg;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg = parseArgs(argc, argv);
+    // counters first: they only follow the calling thread, pool workers are not included
+    PerfCounters perf;
+    TaskPool pool(cfg.threads);
+    mt19937_64 rnd(12345);
+    vector<BenchResult> results;
+
+    if (!perf.available) {
+        cerr << "perf_event_open not permitted - hardware counters are reported as null" << endl;
+    }
+    cerr << left << setw(8) << "type" << setw(15) << "dist" << setw(17) << "algo"
+         << right << setw(12) << "size" << setw(14) << "Melem/s" << setw(16) << "comparisons"
+         << setw(12) << "allocs" << endl;
+    for (size_t n : cfg.sizes) {
+        for (const auto& dist : cfg.dists) {
+            vector<uint64_t> keys = makeKeys(dist, n, rnd);
+            for (const auto& type : cfg.types) {
+                for (const auto& algo : cfg.algos) {
+                    BenchResult r = benchType(cfg, type, dist, algo, keys, pool, perf);
+                    cerr << left << setw(8) << type << setw(15) << dist << setw(17) << algo
+                         << right << setw(12) << n << setw(14) << fixed << setprecision(2)
+                         << (r.seconds > 0 ? n/r.seconds/1e6 : 0.0) << setw(16) << setprecision(0)
+                         << r.comparisons << setw(12) << setprecision(1) << r.allocations << endl;
+                    results.push_back(r);
+                }
+            }
+        }
+    }
+
+    if (cfg.json_path.empty()) {
+        writeJson(cout, cfg, results, perf.available);
+    } else {
+        ofstream out(cfg.json_path);
+        writeJson(out, cfg, results, perf.available);
+    }
+    return 0;
+}